@@ -12,54 +12,79 @@
 /**************************************************************************/
 #if defined(ARDUINO) && ARDUINO >= 100
 	#include "Arduino.h"
+#elif !defined(ARDUINO) && defined(__linux__)
+	#include "PN532_Linux.h"
 #else
 	#include "WProgram.h"
 #endif
 
-#include <Wire.h>
-
 #include "PN532_I2C.h"
 
 //#define PN532_I2C_DEBUG
 //#define PN532_EZLINK_DEBUG
 
 
-#define PN532_PACKBUFFSIZ 64
-byte pn532_packetbuffer[PN532_PACKBUFFSIZ];
+const uint8_t pn532ack[] PROGMEM = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+const uint8_t pn532nack[] PROGMEM = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
 
-byte pn532ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
-byte pn532response_firmwarevers[] = {0x00, 0xFF, 0x06, 0xFA, 0xD5, 0x03};
+// InListPassiveTarget initiator data of FeliCa: the POLLING request payload
+// (system code FFFF, request code 01, time slot 00)
+static const uint8_t pn532_felica_polling[PN532_FELICA_POLLING_LENGTH] PROGMEM = {0x00, 0xFF, 0xFF, 0x01, 0x00};
 
+// Prebuilt command frames, checksums computed by the compiler
 
-/**************************************************************************/
-/*! 
-    @brief  Sends a single byte via I2C
+// SAMConfiguration: normal mode, timeout 50ms * 20 = 1 second, use IRQ pin
+const uint8_t pn532frame_samconfig[] PROGMEM = {
+	PN532_FRAME_START(4),
+	PN532_COMMAND_SAMCONFIGURATION, 0x01, 0x14, 0x01,
+	PN532_FRAME_END(PN532_COMMAND_SAMCONFIGURATION + 0x01 + 0x14 + 0x01)
+};
 
-    @param  x    The byte to send
-*/
-/**************************************************************************/
-static inline void wiresend(uint8_t x) 
-{
-	#if ARDUINO >= 100
-		Wire.write((uint8_t)x);
-	#else
-		Wire.send(x);
-	#endif
-}
+const uint8_t pn532frame_getfirmwareversion[] PROGMEM = {
+	PN532_FRAME_START(1),
+	PN532_COMMAND_GETFIRMWAREVERSION,
+	PN532_FRAME_END(PN532_COMMAND_GETFIRMWAREVERSION)
+};
+
+// InListPassiveTarget: 1 target, 106 kbps type B (EZLink), AFI 0
+const uint8_t pn532frame_inlist_ezlink[] PROGMEM = {
+	PN532_FRAME_START(4),
+	PN532_COMMAND_INLISTPASSIVETARGET, 0x01, 0x03, 0x00,
+	PN532_FRAME_END(PN532_COMMAND_INLISTPASSIVETARGET + 0x01 + 0x03 + 0x00)
+};
+
+// InDataExchange with target 1: CEPAS read purse APDU 90 32 03 00 00 00
+const uint8_t pn532frame_read_ezlink[] PROGMEM = {
+	PN532_FRAME_START(8),
+	PN532_COMMAND_INDATAEXCHANGE, 0x01, 0x90, 0x32, 0x03, 0x00, 0x00, 0x00,
+	PN532_FRAME_END(PN532_COMMAND_INDATAEXCHANGE + 0x01 + 0x90 + 0x32 + 0x03)
+};
+
+// InRelease of target 1
+const uint8_t pn532frame_release_ezlink[] PROGMEM = {
+	PN532_FRAME_START(2),
+	PN532_COMMAND_INRELEASE, 0x01,
+	PN532_FRAME_END(PN532_COMMAND_INRELEASE + 0x01)
+};
+
+// Stages of a command submitted to the asynchronous engine
+#define PN532_STAGE_IDLE          (PN532_ASYNC_IDLE)
+#define PN532_STAGE_WAIT_ACK      (1)
+#define PN532_STAGE_WAIT_RESPONSE (2)
+#define PN532_STAGE_SEND_NACK     (3)
+#define PN532_STAGE_WAIT_RESEND   (4)
+#define PN532_STAGE_WAIT_REST     (5) // Stream transports: rest of the frame
+
+// Instances attached to IRQ interrupts, one interrupt handler per slot
+static PN532_I2C * pn532_irq_instances[PN532_I2C_MAX_IRQ_INSTANCES];
+
+static void pn532_irq0(void) { pn532_irq_instances[0]->handleIRQ(); }
+static void pn532_irq1(void) { pn532_irq_instances[1]->handleIRQ(); }
+
+static void (* const pn532_irq_handlers[PN532_I2C_MAX_IRQ_INSTANCES])(void) = {
+	pn532_irq0, pn532_irq1
+};
 
-/**************************************************************************/
-/*! 
-    @brief  Reads a single byte via I2C
-*/
-/**************************************************************************/
-static inline uint8_t wirerecv(void) 
-{
-	#if ARDUINO >= 100
-		return Wire.read();
-	#else
-		return Wire.receive();
-	#endif
-}
 /*
 char * printHex(int num, int precision) {
       char tmp[16];
@@ -72,72 +97,316 @@ char * printHex(int num, int precision) {
 	return tmp;//Serial.print(tmp);
 }
 */
-char * print8bitHex(int num) {
-	char tmp[16];
-	char format[128];
-    sprintf(format, "%%.%dX", 2);
-	sprintf(tmp, format, num);
-	return tmp;
+#if defined(PN532_I2C_DEBUG) || defined(PN532_EZLINK_DEBUG) || defined(PN532_I2C_TRACE)
+/**************************************************************************/
+/*! 
+    @brief  Prints a byte as two hex digits
+*/
+/**************************************************************************/
+static void print8bitHex(Print & out, uint8_t num) {
+	if (num < 0x10) out.print('0');
+	out.print(num, HEX);
+}
+#endif
+
+
+/**************************************************************************/
+/*! 
+    @brief  Validates a PN532 to host frame: preamble, LCS, DCS and TFI,
+            and optionally the response code
+
+    @param  frame     Pointer to the frame (preamble first)
+    @param  framelen  Number of valid bytes at frame
+    @param  response  Expected response code, 0 to accept any
+
+    @returns  PN532_OK if the frame can be used
+*/
+/**************************************************************************/
+PN532_Status PN532_FrameView::parse(uint8_t * frame, uint8_t framelen, uint8_t response) {
+	uint8_t checksum = 0;
+	
+	_data = 0;
+	_len = 0;
+	
+	if (framelen < 5 ||
+		frame[0] != PN532_PREAMBLE ||
+		frame[1] != PN532_STARTCODE1 ||
+		frame[2] != PN532_STARTCODE2) {
+		return PN532_ERROR_PREAMBLE;
+	}
+	if ((uint8_t)(frame[3] + frame[4]) != 0) return PN532_ERROR_LCS;
+	if ((uint16_t)frame[3] + 6 > framelen) return PN532_ERROR_OVERFLOW;
+	
+	// Data bytes and DCS add up to 0
+	for (uint8_t i=0; i<=frame[3]; i++) {
+		checksum += frame[5 + i];
+	}
+	if (checksum != 0) return PN532_ERROR_DCS;
+	
+	if (frame[3] < 2 || frame[5] != PN532_PN532TOHOST) return PN532_ERROR_TFI;
+	if (response != 0 && frame[6] != response) return PN532_ERROR_RESPONSE;
+	
+	_data = frame + 5;
+	_len = frame[3];
+	return PN532_OK;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Checks the status byte that starts the payload of InDataExchange,
+            InRelease and similar responses
+
+    @returns  PN532_ERROR_CARD if the PN532 or the card reported an error
+*/
+/**************************************************************************/
+PN532_Status PN532_FrameView::checkStatus(void) {
+	if (_data == 0 || _len < 3) return PN532_ERROR_RESPONSE;
+	
+	// Bits 6 and 7 are the MI and NAD flags, not errors
+	return (_data[2] & 0x3F) ? PN532_ERROR_CARD : PN532_OK;
+}
+
+
+#ifdef PN532_MINIMAL
+	uint8_t pn532_shared_buffer[PN532_PACKBUFFSIZ];
+	
+	// The reader allowed to use pn532_shared_buffer: the first one to
+	// init() on it, until it is destroyed. init() of any other one fails
+	// with PN532_ERROR_SHARED.
+	static PN532_I2C * pn532_shared_owner = 0;
+#endif
+
+#ifdef PN532_MINIMAL
+
+/**************************************************************************/
+/*! 
+    @brief  Hands the shared buffer over to the next reader to init()
+*/
+/**************************************************************************/
+PN532_I2C::~PN532_I2C(void) {
+	if (pn532_shared_owner == this) pn532_shared_owner = 0;
 }
 
+#endif
 
 /**************************************************************************/
 /*! 
-    @brief  Creates a PN532_I2C class
+    @brief  Sets up a PN532_I2C class, for its constructors
 
-    @param  irq       Location of the IRQ pin
-    @param  reset     Location of the RSTPD_N pin
+    @param  irq         Location of the IRQ pin, PN532_NO_IRQ if not wired
+    @param  reset       Location of the RSTPD_N pin
+    @param  buffer      Receive buffer
+    @param  buffersize  Its size, at least PN532_I2C_WIRE_BUFSIZ
 */
 /**************************************************************************/
-PN532_I2C::PN532_I2C(uint8_t irq, uint8_t reset) {
+void PN532_I2C::construct(uint8_t irq, uint8_t reset, uint8_t * buffer, uint8_t buffersize) {
   _pin_irq = irq;
   _pin_reset = reset;
+  _packetbuffer = buffer;
+  _packetsize = buffersize;
+  _irq_interrupt = false;
+  _irq_fired = false;
+  _irq_micros = 0;
+  _async_state = PN532_STAGE_IDLE;
+  _async_framelen = 0;
+  _async_timeout = 0;
+  _async_start = 0;
+  _async_callback = 0;
+  _nhandlers = 0;
+  _card_polling = false;
+  _presence_valid = false;
+  _presence_listed = false;
+  _presence_pending = false;
+  _presence_hold = PN532_PRESENCE_HOLD;
+  _presence_seen = 0;
+  _asleep = true;
+  _warm_start = false;
+  _power_fast = PN532_POWER_FAST_INTERVAL;
+  _power_slow = PN532_POWER_SLOW_INTERVAL;
+  _power_interval = PN532_POWER_FAST_INTERVAL;
+  _power_last = 0;
+  _command = 0xFF;
+  _command_adaptive = false;
+  _command_start = 0;
+  _timeout_floor = PN532_TIMEOUT_FLOOR;
+  _timeout_ceiling = PN532_TIMEOUT_CEILING;
+  for (uint8_t i=0; i<PN532_TIMEOUT_COMMANDS; i++) _timeouts[i].command = 0xFF;
+  _ezlink_state = 0;
+  _ezlink_retries = 0;
+  _ezlink_error = PN532_OK;
+  _last_error = PN532_OK;
+  #ifdef PN532_I2C_STATS
+    _stats_command = 0xFF;
+    _stats_start = 0;
+    resetStats();
+  #endif
+  #ifdef PN532_I2C_TRACE
+    clearTrace();
+  #endif
+  #ifdef PN532_I2C_EVENTS
+    _event_head = 0;
+    _event_tail = 0;
+    _event_detected = 0;
+    for (uint8_t i=0; i<PN532_EVENT_TYPES; i++) _event_callbacks[i] = 0;
+  #endif
 
-  pinMode(_pin_irq, INPUT);
+  _poll_backoff = PN532_POLL_MIN_US;
+  _poll_next = 0;
+  if (_pin_irq != PN532_NO_IRQ) pinMode(_pin_irq, INPUT);
+  // Keep a PN532 running since before an MCU reset out of reset, for a
+  // warm init()
+  digitalWrite(_pin_reset, HIGH);
   pinMode(_pin_reset, OUTPUT);
+  digitalWrite(_pin_reset, HIGH);
+}
+
+
+/**************************************************************************/
+/*! 
+    @brief  Captures the IRQ pin falling edge with an interrupt instead
+            of polling the pin level
+
+    @param  enable    true to attach the interrupt, false to detach it
+
+    @returns  false if the IRQ pin has no external interrupt or all
+              interrupt slots are in use
+*/
+/**************************************************************************/
+bool PN532_I2C::useIRQInterrupt(bool enable) {
+	if (_pin_irq == PN532_NO_IRQ) return false;
+	
+	#ifdef digitalPinToInterrupt
+		int8_t irq = digitalPinToInterrupt(_pin_irq);
+		if (irq == NOT_AN_INTERRUPT) return false;
+		
+		for (uint8_t i=0; i<PN532_I2C_MAX_IRQ_INSTANCES; i++) {
+			if (enable && pn532_irq_instances[i] == 0) {
+				clearIRQ();
+				pn532_irq_instances[i] = this;
+				attachInterrupt(irq, pn532_irq_handlers[i], FALLING);
+				_irq_interrupt = true;
+				return true;
+			}
+			if (!enable && pn532_irq_instances[i] == this) {
+				detachInterrupt(irq);
+				pn532_irq_instances[i] = 0;
+				_irq_interrupt = false;
+				return true;
+			}
+		}
+		return false;
+	#else
+		(void)enable;
+		return false;
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Records a PN532 ready signal. Called from the IRQ interrupt.
+*/
+/**************************************************************************/
+void PN532_I2C::handleIRQ(void) {
+	_irq_micros = micros();
+	_irq_fired = true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Forgets the last IRQ edge, before a transfer that will make
+            the PN532 release the IRQ line
+*/
+/**************************************************************************/
+void PN532_I2C::clearIRQ(void) {
+	_irq_fired = false;
 }
 
 
 /**************************************************************************/
 /*! 
-    @brief  Initializes the PN532 hardware (I2C)
+    @brief  Initializes the PN532 hardware. A PN532 still powered since
+            before an MCU reset (watchdog, soft restart) answers a quick
+            probe and is not reset (isWarmStart()). Otherwise the PN532 is
+            reset and polled until it answers. SAMConfiguration is sent
+            either way: the probe cannot tell what state the chip is in.
+            A receive buffer smaller than PN532_I2C_WIRE_BUFSIZ fails
+            with PN532_ERROR_OVERFLOW. With PN532_MINIMAL, a reader on the
+            shared buffer fails with PN532_ERROR_SHARED while another one
+            holds it.
+
+    @param  busclock  I2C clock in Hz (PN532_I2C_CLOCK_STANDARD or
+                      PN532_I2C_CLOCK_FAST), SPI clock in Hz or HSU baud
+                      rate, depending on PN532_TRANSPORT
+    @param  warm      false always resets the PN532
 */
 /**************************************************************************/
-bool PN532_I2C::init() {
-	Wire.begin();
+bool PN532_I2C::init(uint32_t busclock, bool warm) {
+	uint32_t versiondata = 0;
+	uint32_t start;
+	
+	if (_packetsize < PN532_I2C_WIRE_BUFSIZ) {
+		#ifdef PN532_I2C_DEBUG
+			Serial.println(F("PN532_I2C::init: Receive buffer too small"));
+		#endif
+		_last_error = PN532_ERROR_OVERFLOW;
+		return false;
+	}
+	
+	#ifdef PN532_MINIMAL
+		if (hasSharedBuffer() && pn532_shared_owner == 0) pn532_shared_owner = this;
+		if (hasSharedBuffer() && pn532_shared_owner != this) {
+			#ifdef PN532_I2C_DEBUG
+				Serial.println(F("PN532_I2C::init: Shared buffer already used by another reader"));
+			#endif
+			_last_error = PN532_ERROR_SHARED;
+			return false;
+		}
+	#endif
+	
+	_transport.begin(busclock);
+	_asleep = true;
+	_warm_start = false;
 	
-	// Reset the PN532  
-	digitalWrite(_pin_reset, HIGH);
-	digitalWrite(_pin_reset, LOW);
-	delay(400);
-	digitalWrite(_pin_reset, HIGH);
+	if (warm) {
+		// Abort a command cut short by the MCU reset, then probe
+		wakeUp();
+		wiresendack();
+		versiondata = getPN532FirmwareVersion(PN532_WARM_PROBE_TIMEOUT);
+	}
 	
-	uint32_t versiondata = getPN532FirmwareVersion();
+	if (versiondata) {
+		_warm_start = true;
+	} else {
+		// Reset the PN532, then poll it until it has started
+		digitalWrite(_pin_reset, LOW);
+		delay(PN532_RESET_PULSE);
+		digitalWrite(_pin_reset, HIGH);
+		
+		start = millis();
+		do {
+			_asleep = true;
+			versiondata = getPN532FirmwareVersion(PN532_RESET_POLL);
+		} while (!versiondata && millis() - start < PN532_RESET_TIMEOUT);
+	}
 	
 	if (! versiondata) {
 		#ifdef PN532_I2C_DEBUG
-			Serial.println("PN532_I2C::init: PN532 Board not connected.");
+			Serial.println(F("PN532_I2C::init: PN532 Board not connected."));
 		#endif
 		//while (1); // halt
 		return false;
 	}
 	#ifdef PN532_I2C_DEBUG
-		Serial.print("PN532_I2C::init: PN5"); Serial.print((versiondata>>24) & 0xFF, HEX);
-		Serial.print(" chip (Firmware ver. ");
+		Serial.print(F("PN532_I2C::init: PN5")); Serial.print((versiondata>>24) & 0xFF, HEX);
+		Serial.print(F(" chip (Firmware ver. "));
 		Serial.print((versiondata>>16) & 0xFF, DEC);
 		Serial.print('.'); Serial.print((versiondata>>8) & 0xFF, DEC);
-		Serial.println(") found.");
+		Serial.println(F(") found."));
+		if (_warm_start) Serial.println(F("PN532_I2C::init: Warm start, PN532 not reset"));
 	#endif
 	
-	pn532_packetbuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
-	pn532_packetbuffer[1] = 0x01; // normal mode;
-	pn532_packetbuffer[2] = 0x14; // timeout 50ms * 20 = 1 second
-	pn532_packetbuffer[3] = 0x01; // use IRQ pin!
-
-	if (! sendCommandCheckAck(pn532_packetbuffer, 4)) return false;
-	// read data packet
-	wirereaddata(pn532_packetbuffer, 8);
-	return  (pn532_packetbuffer[6] == 0x15);
+	return sendFrameReadResponse(pn532frame_samconfig, sizeof(pn532frame_samconfig),
+		PN532_COMMAND_SAMCONFIGURATION + 1, 1000) == PN532_OK;
 }
 
 
@@ -145,102 +414,310 @@ bool PN532_I2C::init() {
 /*! 
     @brief  Checks the firmware version of the PN5XX chip
 
+    @param  timeout   Time in ms allowed for the answer
+
     @returns  The NP532's firmware version and ID
 */
 /**************************************************************************/
-uint32_t PN532_I2C::getPN532FirmwareVersion(void) {
+uint32_t PN532_I2C::getPN532FirmwareVersion(uint16_t timeout) {
 	uint32_t response;
-	pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
-	
-	if (! sendCommandCheckAck(pn532_packetbuffer, 1)) return 0;
+	uint8_t * payload;
 	
-	// read data packet
-	wirereaddata(pn532_packetbuffer, 12);
-	
-	// check some basic stuff
-	if (0 != strncmp((char *)pn532_packetbuffer, (char *)pn532response_firmwarevers, 6)) {
+	if (sendFrameReadResponse(pn532frame_getfirmwareversion, sizeof(pn532frame_getfirmwareversion),
+		PN532_COMMAND_GETFIRMWAREVERSION + 1, timeout) != PN532_OK ||
+		_frame.getPayloadLength() < 4) {
 		#ifdef PN532_I2C_DEBUG
-			Serial.println("PN532_I2C::getPN532FirmwareVersion: Firmware doesn't match!");
+			Serial.println(F("PN532_I2C::getPN532FirmwareVersion: Firmware doesn't match!"));
 		#endif
 		return 0;
 	}
 	
-	response = pn532_packetbuffer[7];
+	// IC, Ver, Rev, Support
+	payload = _frame.getPayload();
+	response = payload[0];
 	response <<= 8;
-	response |= pn532_packetbuffer[8];
+	response |= payload[1];
 	response <<= 8;
-	response |= pn532_packetbuffer[9];
+	response |= payload[2];
 	response <<= 8;
-	response |= pn532_packetbuffer[10];
+	response |= payload[3];
 	
 	return response;
 }
 
 /**************************************************************************/
 /*! 
-    @brief  Sends a command and waits a specified period for the ACK
+    @brief  Sends a prebuilt frame and reads the response frame into
+            the packet buffer
+
+    @param  frame     Pointer to the frame, in PROGMEM
+    @param  framelen  The size of the frame in bytes 
+    @param  response  Expected response code
+    @param  timeout   Time in ms allowed for the response
+
+    @returns  PN532_OK, or the reason of the failure (also kept for
+              getLastError())
+*/
+/**************************************************************************/
+PN532_Status PN532_I2C::sendFrameReadResponse(const uint8_t *frame, uint8_t framelen, uint8_t response, uint16_t timeout) {
+	wiresendframe_P(frame, framelen);
+	
+	return readResponse(response, timeout);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sends a command and reads the response frame into the packet
+            buffer
 
     @param  cmd       Pointer to the command buffer
     @param  cmdlen    The size of the command in bytes 
-    @param  timeout   timeout before giving up
-    
-    @returns  1 if everything is OK, 0 if timeout occured before an
-              ACK was recieved
+    @param  response  Expected response code
+    @param  timeout   Time in ms allowed for the response
 */
 /**************************************************************************/
-// default timeout of one second
-bool PN532_I2C::sendCommandCheckAck(uint8_t *cmd, uint8_t cmdlen, uint16_t timeout) {
-	uint16_t timer = 0;
-	
-	// write the command
+PN532_Status PN532_I2C::sendCommandReadResponse(uint8_t *cmd, uint8_t cmdlen, uint8_t response, uint16_t timeout) {
 	wiresendcommand(cmd, cmdlen);
 	
-	// Wait for chip to say its ready!
-	while (wirereadstatus() != PN532_I2C_READY) {
-		if (timeout != 0) {
-			timer+=10;
-			if (timer > timeout) return false;
+	return readResponse(response, timeout);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads the ACK and the response frame of the command just sent
+
+    @param  response  Expected response code
+    @param  timeout   Time in ms allowed for the ACK and for the response,
+                      or PN532_TIMEOUT_ADAPTIVE
+*/
+/**************************************************************************/
+PN532_Status PN532_I2C::readResponse(uint8_t response, uint16_t timeout) {
+	uint8_t ackbuff[6];
+	uint8_t len;
+	
+	_command_adaptive = (timeout == PN532_TIMEOUT_ADAPTIVE);
+	if (_command_adaptive) timeout = getTimeout(_command);
+	// An answer waited for without deadline is no latency sample
+	if (timeout == 0) _command = 0xFF;
+	
+	_last_error = PN532_ERROR_TIMEOUT;
+	if (waitReadData(ackbuff, 6, timeout)) {
+		#ifdef PN532_I2C_STATS
+			recordStats(PN532_STATS_ACK);
+		#endif
+		
+		_last_error = PN532_ERROR_NACK;
+		if (memcmp_P(ackbuff, pn532ack, 6) == 0) {
+			_last_error = PN532_ERROR_TIMEOUT;
+			beginWait(true);
+			if (waitReadData(_packetbuffer, 5, timeout)) {
+				#ifdef PN532_I2C_STATS
+					recordStats(PN532_STATS_RESPONSE);
+				#endif
+				learnTimeout();
+				
+				len = wirereadframe(_packetbuffer, _packetsize);
+				if (len > 0) {
+					_last_error = _frame.parse(_packetbuffer, len, response);
+					#ifdef PN532_I2C_STATS
+						if (_last_error == PN532_OK) recordStats(PN532_STATS_READ);
+					#endif
+				}
+			}
 		}
-		delay(10);
 	}
-
-	#ifdef PN532_I2C_DEBUG
-		Serial.println("PN532_I2C::sendCommandCheckAck: IRQ received");
+	
+	if (_last_error == PN532_ERROR_TIMEOUT) {
+		// Stop the PN532 working on a command given up on
+		wiresendack();
+		backoffTimeout();
+	}
+	
+	#ifdef PN532_I2C_STATS
+		recordError(_last_error);
 	#endif
+	return _last_error;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Finds the latency estimate of a command code
+
+    @param  command   Command code
+    @param  create    Takes a free slot if the code has none yet
+
+    @returns  The estimate, or 0 if the code is not tracked
+*/
+/**************************************************************************/
+PN532_CommandTimeout * PN532_I2C::findTimeout(uint8_t command, bool create) {
+	PN532_CommandTimeout * t;
 	
-	// read acknowledgement
-	if (!readackframe()) {
-		#ifdef PN532_I2C_DEBUG
-			Serial.println("PN532_I2C::sendCommandCheckAck: No ACK frame received!");
-		#endif
-		return false;
+	if (command == 0xFF) return 0;
+	for (uint8_t i=0; i<PN532_TIMEOUT_COMMANDS; i++) {
+		t = &_timeouts[i];
+		if (t->command == command) return t;
+		if (t->command == 0xFF) {
+			if (!create) return 0;
+			t->command = command;
+			t->srtt = 0;
+			t->rttvar = 0;
+			t->floor = _timeout_floor;
+			t->ceiling = (command == PN532_COMMAND_INLISTPASSIVETARGET) ?
+				PN532_TIMEOUT_CEILING_SEARCH : _timeout_ceiling;
+			return t;
+		}
+	}
+	// Table full, this command keeps the default ceiling
+	return 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Adds the latency of the command just answered (from sending
+            it to its response being ready) to its estimate. A command
+            waited for with an explicit timeout only updates a slot it
+            already has.
+*/
+/**************************************************************************/
+void PN532_I2C::learnTimeout(void) {
+	PN532_CommandTimeout * t = findTimeout(_command, _command_adaptive);
+	uint32_t sample = (micros() - _command_start) / 125; // 1/8 ms
+	int32_t delta;
+	
+	if (t == 0) return;
+	if (sample == 0) sample = 1;
+	if (sample > 0x7FFF) sample = 0x7FFF;
+	
+	if (t->srtt == 0) {
+		t->srtt = sample;
+		t->rttvar = sample / 2;
+		return;
 	}
+	delta = (int32_t)sample - t->srtt;
+	t->srtt += delta / 8;
+	if (delta < 0) delta = -delta;
+	t->rttvar += (delta - (int32_t)t->rttvar) / 4;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Doubles the next deadline of the command that just timed out,
+            up to its ceiling. The timed out command itself is not a
+            latency sample.
+
+    An InListPassiveTarget timeout is the normal answer when no card is
+    in the field, not a slow chip: its deadline is left alone.
+*/
+/**************************************************************************/
+void PN532_I2C::backoffTimeout(void) {
+	PN532_CommandTimeout * t = findTimeout(_command, false);
+	uint32_t deadline, limit, rttvar;
+	
+	if (t == 0 || t->srtt == 0) return;
+	if (_command == PN532_COMMAND_INLISTPASSIVETARGET) return;
 	
-	return true; // ack'd command
+	// Double the deadline that actually timed out, floor included (in
+	// 1/8 ms), but not past the ceiling. Only rttvar grows, so that a few
+	// good samples bring it back down.
+	deadline = (uint32_t)t->srtt + 4 * (uint32_t)t->rttvar;
+	if (deadline < (uint32_t)t->floor * 8) deadline = (uint32_t)t->floor * 8;
+	deadline *= 2;
+	limit = (uint32_t)t->ceiling * 8;
+	if (deadline > limit) deadline = limit;
+	
+	rttvar = (deadline > t->srtt) ? (deadline - t->srtt + 3) / 4 : 0;
+	if (rttvar < t->rttvar) rttvar = t->rttvar;
+	t->rttvar = (rttvar > 0x7FFF) ? 0x7FFF : rttvar;
 }
 
 /**************************************************************************/
 /*! 
-    @brief  Tries to read the PN532 ACK frame (not to be confused with 
-	        the I2C ACK signal)
+    @brief  Sets the floor and ceiling of all adaptive timeouts
+
+    @param  floor     Shortest deadline in ms
+    @param  ceiling   Longest deadline in ms, also the deadline of a
+                      command not timed yet
 */
 /**************************************************************************/
-bool PN532_I2C::readackframe(void) {
-	uint8_t ackbuff[6];
+void PN532_I2C::setTimeoutBounds(uint16_t floor, uint16_t ceiling) {
+	_timeout_floor = floor;
+	_timeout_ceiling = ceiling;
+	for (uint8_t i=0; i<PN532_TIMEOUT_COMMANDS && _timeouts[i].command != 0xFF; i++) {
+		_timeouts[i].floor = floor;
+		_timeouts[i].ceiling = ceiling;
+	}
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sets the floor and ceiling of the adaptive timeout of one
+            command, for example a longer ceiling for a slow card
+            protocol exchanged with InDataExchange
+
+    @param  command   Command code, PN532_COMMAND_*
+    @param  floor     Shortest deadline in ms
+    @param  ceiling   Longest deadline in ms
+*/
+/**************************************************************************/
+void PN532_I2C::setTimeoutBounds(uint8_t command, uint16_t floor, uint16_t ceiling) {
+	PN532_CommandTimeout * t = findTimeout(command, true);
+	
+	if (t == 0) return;
+	t->floor = floor;
+	t->ceiling = ceiling;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Deadline PN532_TIMEOUT_ADAPTIVE currently gives a command
+
+    @param  command   Command code, PN532_COMMAND_*
+
+    @returns  Time in ms allowed for the ACK and for the response
+*/
+/**************************************************************************/
+uint16_t PN532_I2C::getTimeout(uint8_t command) {
+	PN532_CommandTimeout * t = findTimeout(command, false);
+	uint32_t deadline;
 	
-	wirereaddata(ackbuff, 6);
+	if (t == 0) {
+		return (command == PN532_COMMAND_INLISTPASSIVETARGET) ?
+			PN532_TIMEOUT_CEILING_SEARCH : _timeout_ceiling;
+	}
+	if (t->srtt == 0) return t->ceiling;
 	
-	return (0 == strncmp((char *)ackbuff, (char *)pn532ack, 6));
+	deadline = ((uint32_t)t->srtt + 4 * (uint32_t)t->rttvar + 7) / 8;
+	if (deadline < t->floor) deadline = t->floor;
+	if (deadline > t->ceiling) deadline = t->ceiling;
+	return deadline;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Forgets the learned latencies, keeping the bounds. Card side
+            timings changed with applyRFPreset() reset them too.
+*/
+/**************************************************************************/
+void PN532_I2C::resetTimeouts(void) {
+	for (uint8_t i=0; i<PN532_TIMEOUT_COMMANDS; i++) {
+		_timeouts[i].srtt = 0;
+		_timeouts[i].rttvar = 0;
+	}
 }
 
 /**************************************************************************/
 /*! 
-    @brief  Checks the IRQ pin to know if the PN532 is ready
+    @brief  Checks the IRQ pin (or the IRQ interrupt flag) to know if
+            the PN532 is ready
 	
 	@returns 0 if the PN532 is busy, 1 if it is free
 */
 /**************************************************************************/
 uint8_t PN532_I2C::wirereadstatus(void) {
+	if (_irq_interrupt) {
+		return _irq_fired ? PN532_I2C_READY : PN532_I2C_BUSY;
+	}
+	
 	uint8_t x = digitalRead(_pin_irq);
 
 	if (x == 1)
@@ -251,479 +728,2063 @@ uint8_t PN532_I2C::wirereadstatus(void) {
 
 /**************************************************************************/
 /*! 
-    @brief  Reads n bytes of data from the PN532 via I2C
+    @brief  Reads n bytes of data from the PN532 through the transport
 
     @param  buff      Pointer to the buffer where data will be written
     @param  n         Number of bytes to be read
+
+    @returns  false if the PN532 was not ready
 */
 /**************************************************************************/
-void PN532_I2C::wirereaddata(uint8_t* buff, uint8_t n) {
-	uint16_t timer = 0;
+bool PN532_I2C::wirereaddata(uint8_t* buff, uint8_t n) {
+	bool ready;
 	
-	delay(2);
+	// Reading releases IRQ
+	clearIRQ();
+	ready = _transport.read(buff, n);
 	
-	#ifdef PN532_I2C_DEBUG
-		Serial.print("PN532_I2C::wirereaddata: Reading: 0x");
+	#ifdef PN532_I2C_TRACE
+		// Busy status polls (no IRQ pin) would flush the frames out of the ring
+		if (ready) recordTrace(PN532_TRACE_RX, buff, n);
 	#endif
 	
-	// Start read (n+1 to take into account leading 0x01 with I2C)
-	Wire.requestFrom((uint8_t)PN532_I2C_ADDRESS, (uint8_t)(n+2));
-	// Discard the leading 0x01
-	wirerecv();
-	for (uint8_t i=0; i<n; i++) {
-		delay(1);
-		buff[i] = wirerecv();
-		#ifdef PN532_I2C_DEBUG
-			//Serial.print(" 0x");
-			//Serial.print(buff[i], HEX);
-			Serial.print(" "); Serial.print(print8bitHex(buff[i]));
-		#endif
-	}
-	// Discard trailing 0x00 0x00
-	// wirerecv();
-	
 	#ifdef PN532_I2C_DEBUG
+		Serial.print(F("PN532_I2C::wirereaddata: Reading: 0x"));
+		for (uint8_t i=0; i<n; i++) {
+			Serial.print(F(" ")); print8bitHex(Serial, buff[i]);
+		}
 		Serial.println();
+		if (!ready) Serial.println(F("PN532_I2C::wirereaddata: PN532 was not ready"));
 	#endif
+	return ready;
 }
 
+#ifdef PN532_TRANSPORT_STREAM
 /**************************************************************************/
 /*! 
-    @brief  Writes a command to the PN532, automatically inserting the
-            preamble and required frame details (checksum, len, etc.)
+    @brief  Reads the bytes of a frame that have arrived so far, at most n
 
-    @param  cmd       Pointer to the command buffer
-    @param  cmdlen    Command length in bytes 
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Largest number of bytes to read
+
+    @returns  The number of bytes read
 */
 /**************************************************************************/
-void PN532_I2C::wiresendcommand(uint8_t* cmd, uint8_t cmdlen) {
-	uint8_t checksum;
-	
-	cmdlen++;
+uint8_t PN532_I2C::wirereadavailable(uint8_t* buff, uint8_t n) {
+	uint8_t got = _transport.readAvailable(buff, n);
 	
-	#ifdef PN532_I2C_DEBUG
-		Serial.print("PN532_I2C::wiresendcommand: Sending: 0x");
-	#endif
-
-	delay(2);     // or whatever the delay is for waking up the board
-
-	// I2C START
-	Wire.beginTransmission(PN532_I2C_ADDRESS);
-	checksum = PN532_PREAMBLE + PN532_PREAMBLE + PN532_STARTCODE2;
-	wiresend(PN532_PREAMBLE);
-	wiresend(PN532_PREAMBLE);
-	wiresend(PN532_STARTCODE2);
-
-	wiresend(cmdlen);
-	wiresend(~cmdlen + 1);
-
-	wiresend(PN532_HOSTTOPN532);
-	checksum += PN532_HOSTTOPN532;
-
-	#ifdef PN532_I2C_DEBUG
-		Serial.print(" "); Serial.print(print8bitHex(PN532_PREAMBLE));
-		Serial.print(" "); Serial.print(print8bitHex(PN532_PREAMBLE));
-		Serial.print(" "); Serial.print(print8bitHex(PN532_STARTCODE2));
-		Serial.print(" "); Serial.print(print8bitHex(cmdlen));
-		Serial.print(" "); Serial.print(print8bitHex((uint8_t)(~cmdlen + 1)));
-		Serial.print(" "); Serial.print(print8bitHex(PN532_HOSTTOPN532));
-		/*Serial.print(" 0x"); Serial.print(PN532_PREAMBLE, HEX);
-		Serial.print(" 0x"); Serial.print(PN532_PREAMBLE, HEX);
-		Serial.print(" 0x"); Serial.print(PN532_STARTCODE2, HEX);
-		Serial.print(" 0x"); Serial.print(cmdlen, HEX);
-		Serial.print(" 0x"); Serial.print(~cmdlen + 1, HEX);
-		Serial.print(" 0x"); Serial.print(PN532_HOSTTOPN532, HEX);
-		*/
-	#endif
-
-	for (uint8_t i=0; i<cmdlen-1; i++) {
-		wiresend(cmd[i]);
-		checksum += cmd[i];
-		#ifdef PN532_I2C_DEBUG
-			Serial.print(" "); Serial.print(print8bitHex(cmd[i]));
-			//Serial.print(" 0x"); Serial.print(cmd[i], HEX);
-		#endif
-	}
-
-	wiresend(~checksum);
-	wiresend(PN532_POSTAMBLE);
-
-	// I2C STOP
-	Wire.endTransmission();
-
-	#ifdef PN532_I2C_DEBUG
-		//Serial.print(" 0x"); Serial.print(~checksum, HEX);
-		//Serial.print(" 0x"); Serial.print(PN532_POSTAMBLE, HEX);
-		Serial.print(" "); Serial.print(print8bitHex((uint8_t)(~checksum)));
-		Serial.print(" "); Serial.print(print8bitHex(PN532_POSTAMBLE));
-		Serial.println();
+	#ifdef PN532_I2C_TRACE
+		if (got > 0) recordTrace(PN532_TRACE_RX, buff, got);
 	#endif
+	return got;
 }
-
+#endif
 
 /**************************************************************************/
 /*! 
-    @brief  Waits until the PN532 is ready.
+    @brief  Checks a frame header and computes the length of the frame
 
-    @param  timeout   Timeout before giving up
+    @param  header    The 5 first bytes of a frame
+    @param  maxlen    Size of the buffer the frame will be read into
+
+    @returns  The number of bytes to read (at most maxlen, and at most
+              PN532_TRANSPORT_READ_MAX), or 0 if the header is invalid.
+              A longer frame is read cut short and fails to parse with
+              PN532_ERROR_OVERFLOW.
 */
 /**************************************************************************/
-bool PN532_I2C::waitUntilReady(uint16_t timeout) {
-	uint16_t timer = 0;
-	while(wirereadstatus() != PN532_I2C_READY) {
-		if (timeout != 0) {
-			timer += 10;
-			if (timer > timeout) {
-				return false;
-			}
-		}
-		delay(10);
+static uint8_t pn532_framelength(uint8_t* header, uint8_t maxlen) {
+	uint16_t framelen;
+	
+	if (header[0] != PN532_PREAMBLE ||
+		header[1] != PN532_STARTCODE1 ||
+		header[2] != PN532_STARTCODE2 ||
+		header[4] != (uint8_t)(~header[3] + 1)) {
+		return 0;
 	}
-	return true;
+	
+	// Preamble, start code, LEN, LCS, data (LEN bytes), DCS, postamble
+	framelen = (uint16_t)header[3] + 7;
+	if (framelen > maxlen) framelen = maxlen;
+	if (framelen > PN532_TRANSPORT_READ_MAX) framelen = PN532_TRANSPORT_READ_MAX;
+	return (uint8_t)framelen;
 }
 
-bool PN532_I2C::checkForEZLink(uint8_t * ezlink, float * balance) {
-	pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-	pn532_packetbuffer[1] = 1;
-	pn532_packetbuffer[2] = 3;
-	pn532_packetbuffer[3] = 0;
+/**************************************************************************/
+/*! 
+    @brief  Parses the target data of one target found by InAutoPoll or
+            InListPassiveTarget
 
-	#ifdef PN532_EZLINK_DEBUG 
-		Serial.println("PN532_I2C::checkForEZLink: Searching for EZLink Cards around");
-	#endif
+    @param  type      Target type (PN532_TARGET_*)
+    @param  data      Target data, starting with Tg
+    @param  len       Bytes available at data
+    @param  target    Receives the target
 
-	if (!sendCommandCheckAck(pn532_packetbuffer,4)){//,1000)) {
-		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Could not search for EZLink Cards");
-		#endif
-		return false;
+    @returns  The number of bytes of target data, 0 if malformed
+*/
+/**************************************************************************/
+static uint8_t pn532_parsetarget(uint8_t type, const uint8_t * data, uint8_t len, PN532_Target * target) {
+	uint8_t used;
+	
+	if (len < 1) return 0;
+	
+	target->tg = data[0];
+	target->type = type;
+	target->sak = 0;
+	target->idlen = 0;
+	
+	switch (type) {
+		case PN532_TARGET_GENERIC_106A:
+		case PN532_TARGET_MIFARE:
+		case PN532_TARGET_ISO14443_4A:
+			// Tg, SENS_RES (2), SEL_RES, NFCIDLength, NFCID, [ATS]
+			if (len < 5 || len < 5 + data[4]) return 0;
+			target->sak = data[3];
+			target->idlen = (data[4] < PN532_TARGET_ID_LENGTH) ? data[4] : PN532_TARGET_ID_LENGTH;
+			memcpy(target->id, data + 5, target->idlen);
+			used = 5 + data[4];
+			// ISO/IEC 14443-4 targets also report their ATS
+			if ((target->sak & 0x20) && used < len) used += data[used];
+			break;
+		case PN532_TARGET_GENERIC_106B:
+		case PN532_TARGET_ISO14443_4B:
+			// Tg, ATQB (12), ATTRIB_RES length, ATTRIB_RES
+			if (len < 14) return 0;
+			target->idlen = 12;
+			memcpy(target->id, data + 1, 12);
+			used = 14 + data[13];
+			break;
+		case PN532_TARGET_FELICA_212:
+		case PN532_TARGET_FELICA_424:
+			// Tg, POL_RES length, 0x01, IDm (8), PMm (8), [SYST_CODE]
+			if (len < 11) return 0;
+			target->idlen = 8;
+			memcpy(target->id, data + 3, 8);
+			used = 1 + data[1];
+			break;
+		case PN532_TARGET_JEWEL:
+			// Tg, SENS_RES (2), JEWELID (4)
+			if (len < 7) return 0;
+			target->idlen = 4;
+			memcpy(target->id, data + 3, 4);
+			used = 7;
+			break;
+		default:
+			return 0;
 	}
+	
+	return (used <= len) ? used : 0;
+}
 
-	//  if (!waitUntilReady(30000)) {
-	if (!waitUntilReady(2000)) {
-		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Chip timedout");
+/**************************************************************************/
+/*! 
+    @brief  Reads a complete response frame from the PN532
+
+    The frame header (preamble, start code, LEN and LCS) has been read
+    into buff when the PN532 became ready. The PN532 is then asked to
+    resend the frame (NACK) and exactly LEN + 7 bytes are read, instead
+    of a fixed sized buffer.
+
+    @param  buff      Pointer to the buffer holding the header, where the
+                      frame will be written
+    @param  maxlen    Size of the buffer in bytes
+
+    @returns  The number of bytes written to buff. If the header is
+              invalid, only the 5 header bytes are returned. 0 if the
+              frame was not resent, with _last_error set to
+              PN532_ERROR_OVERFLOW if the bus could not take it whole.
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::wirereadframe(uint8_t* buff, uint8_t maxlen) {
+	uint8_t framelen;
+	#ifdef PN532_TRANSPORT_STREAM
+		uint8_t got, n;
+		uint32_t start;
+	#endif
+	
+	if (maxlen < 5) return 0;
+	
+	framelen = pn532_framelength(buff, maxlen);
+	if (framelen == 0) {
+		// Let the caller report the broken header
+		return 5;
+	}
+	
+	#ifdef PN532_TRANSPORT_STREAM
+		// The rest of the frame follows the header, taken as it arrives
+		got = 5;
+		start = millis();
+		while (got < framelen) {
+			n = wirereadavailable(buff + got, framelen - got);
+			if (n > 0) {
+				got += n;
+				start = millis();
+			} else if (millis() - start > PN532_HSU_TIMEOUT) {
+				return 0;
+			}
+		}
+	#else
+		// Ask the PN532 to send the same frame again, this time in full
+		wiresendnack();
+		if (!waitReadData(buff, framelen, PN532_I2C_RESEND_TIMEOUT)) {
+			#ifdef PN532_I2C_DEBUG
+				Serial.println(F("PN532_I2C::wirereadframe: Frame was not resent"));
+			#endif
+			#ifdef PN532_TRANSPORT_SHORT_READS
+				if (_transport.shortRead()) _last_error = PN532_ERROR_OVERFLOW;
+			#endif
+			return 0;
+		}
+	#endif
+	return framelen;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes a NACK frame, asking the PN532 to resend its last
+            response frame
+*/
+/**************************************************************************/
+void PN532_I2C::wiresendnack(void) {
+	uint8_t nack[sizeof(pn532nack)];
+	
+	memcpy_P(nack, pn532nack, sizeof(nack));
+	wirewrite(nack, sizeof(nack));
+	beginWait(false);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes an ACK frame, telling the PN532 to drop the command in
+            progress
+*/
+/**************************************************************************/
+void PN532_I2C::wiresendack(void) {
+	uint8_t ack[sizeof(pn532ack)];
+	
+	memcpy_P(ack, pn532ack, sizeof(ack));
+	wirewrite(ack, sizeof(ack));
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes a command to the PN532, automatically inserting the
+            preamble and required frame details (checksum, len, etc.)
+
+    @param  cmd       Pointer to the command buffer
+    @param  cmdlen    Command length in bytes 
+*/
+/**************************************************************************/
+void PN532_I2C::wiresendcommand(uint8_t* cmd, uint8_t cmdlen) {
+	uint8_t frame[PN532_I2C_WIRE_BUFSIZ];
+	uint8_t checksum;
+	uint8_t i;
+	
+	if (cmdlen > sizeof(frame) - PN532_FRAME_SIZE(0)) {
+		#ifdef PN532_I2C_DEBUG
+			Serial.println(F("PN532_I2C::wiresendcommand: Command too long"));
 		#endif
-		return false;
+		return;
+	}
+	
+	cmdlen++;
+	
+	frame[0] = PN532_PREAMBLE;
+	frame[1] = PN532_STARTCODE1;
+	frame[2] = PN532_STARTCODE2;
+	frame[3] = cmdlen;
+	frame[4] = ~cmdlen + 1;
+	frame[5] = PN532_HOSTTOPN532;
+	checksum = PN532_HOSTTOPN532;
+	
+	for (i=0; i<cmdlen-1; i++) {
+		frame[6 + i] = cmd[i];
+		checksum += cmd[i];
 	}
+	
+	frame[6 + i] = ~checksum + 1;
+	frame[7 + i] = PN532_POSTAMBLE;
+	
+	wiresendframe(frame, 8 + i);
+}
 
-	wirereaddata(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+/**************************************************************************/
+/*! 
+    @brief  Writes a complete frame to the PN532 in one transfer
 
-	if (pn532_packetbuffer[0] == 0 &&
-		pn532_packetbuffer[1] == 0 &&
-		pn532_packetbuffer[2] == 0xff) {
-		uint8_t length = pn532_packetbuffer[3];
-		if (pn532_packetbuffer[4] != (uint8_t)(~length+1)) {
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.print("PN532_I2C::checkForEZLink: ERROR - Invalid length from checking the incoming message (0x");
-				Serial.print(print8bitHex(length)); Serial.print(" / 0x");
-				Serial.print(print8bitHex(uint8_t(~length + 1)));
-				Serial.println(")");
-			#endif
-			return false;
+    @param  frame     Pointer to the frame
+    @param  framelen  Frame length in bytes 
+*/
+/**************************************************************************/
+void PN532_I2C::wiresendframe(const uint8_t* frame, uint8_t framelen) {
+	#ifdef PN532_I2C_DEBUG
+		Serial.print(F("PN532_I2C::wiresendcommand: Sending: 0x"));
+		for (uint8_t i=0; i<framelen; i++) {
+			Serial.print(F(" ")); print8bitHex(Serial, frame[i]);
 		}
-		if (pn532_packetbuffer[5] == PN532_PN532TOHOST &&
-			pn532_packetbuffer[6] == PN532_RESPONSE_INLISTPASSIVETARGET) {
-			if (pn532_packetbuffer[7] != 1) {
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.print("PN532_I2C::checkForEZLink: ERROR - More than 1 tag found (Total: ");
-					Serial.print(pn532_packetbuffer[7]);
-					Serial.println(")");
-				#endif
-				return false;
-			}
-			
-			inListedTag = pn532_packetbuffer[8];
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.print("PN532_I2C::checkForEZLink: Found Tag number: ");
-				Serial.println(inListedTag);
-			#endif
+		Serial.println();
+	#endif
+
+	wakeUp();
+	wirewrite(frame, framelen);
+	_command = frame[6];
+	_command_start = micros();
+	beginWait(false);
+	
+	#ifdef PN532_I2C_STATS
+		_stats_command = frame[6];
+		_stats_start = micros();
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Wakes the PN532 up if it is in PowerDown (or just reset), the
+            only case where it needs time before taking a frame
+*/
+/**************************************************************************/
+void PN532_I2C::wakeUp(void) {
+	if (!_asleep) return;
+	
+	_transport.wake();
+	delay(PN532_WAKE_DELAY);
+	_asleep = false;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes a prebuilt frame stored in PROGMEM to the PN532
+
+    @param  frame     Pointer to the frame, in PROGMEM
+    @param  framelen  Frame length in bytes 
+*/
+/**************************************************************************/
+void PN532_I2C::wiresendframe_P(const uint8_t* frame, uint8_t framelen) {
+	uint8_t buff[PN532_I2C_WIRE_BUFSIZ];
+	
+	if (framelen > sizeof(buff)) return;
+	
+	memcpy_P(buff, frame, framelen);
+	wiresendframe(buff, framelen);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes n raw bytes to the PN532 in one transfer
+
+    @param  buff      Pointer to the bytes
+    @param  n         Number of bytes 
+*/
+/**************************************************************************/
+void PN532_I2C::wirewrite(const uint8_t* buff, uint8_t n) {
+	// The PN532 releases IRQ once it gets a new frame
+	clearIRQ();
+	
+	_transport.write(buff, n);
+	
+	#ifdef PN532_I2C_TRACE
+		recordTrace(PN532_TRACE_TX, buff, n);
+	#endif
+}
+
+
+/**************************************************************************/
+/*! 
+    @brief  Starts waiting for the PN532 to be ready, after a frame was
+            sent. Without IRQ pin, sets when the status byte is first read.
+
+    @param  response  Waiting for a response: the first read comes after
+                      half the usual latency of the command
+*/
+/**************************************************************************/
+void PN532_I2C::beginWait(bool response) {
+	PN532_CommandTimeout * t;
+	uint32_t first = PN532_POLL_MIN_US;
+	
+	if (_pin_irq != PN532_NO_IRQ) return;
+	
+	if (response) {
+		t = findTimeout(_command, false);
+		if (t != 0 && (uint32_t)t->srtt * 125 / 2 > first) first = (uint32_t)t->srtt * 125 / 2;
+	}
+	_poll_backoff = PN532_POLL_MIN_US;
+	_poll_next = micros() + first;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads n bytes if the PN532 is ready, never waits.
+
+    With an IRQ pin, the pin (or the interrupt flag) tells when to read.
+    Without, the read itself is the readiness check: the status byte
+    leading it tells whether the bytes read along are valid. Reads that
+    find the PN532 busy back off exponentially, from PN532_POLL_MIN_US to
+    PN532_POLL_MAX_US apart, so the bus is not hammered.
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Number of bytes to be read
+
+    @returns  true if the bytes were read
+*/
+/**************************************************************************/
+bool PN532_I2C::readWhenReady(uint8_t* buff, uint8_t n) {
+	#ifdef PN532_TRANSPORT_STREAM
+		// The bytes waiting in the UART buffer tell, without bus traffic
+		return wirereaddata(buff, n);
+	#else
+		if (_pin_irq != PN532_NO_IRQ) {
+			if (wirereadstatus() != PN532_I2C_READY) return false;
+			return wirereaddata(buff, n);
+		}
+		
+		// Not due yet
+		if ((int32_t)(micros() - _poll_next) < 0) return false;
+		
+		if (wirereaddata(buff, n)) return true;
+		
+		_poll_next = micros() + _poll_backoff;
+		if (_poll_backoff < PN532_POLL_MAX_US) _poll_backoff *= 2;
+		if (_poll_backoff > PN532_POLL_MAX_US) _poll_backoff = PN532_POLL_MAX_US;
+		return false;
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Waits until the PN532 is ready and reads n bytes
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Number of bytes to be read
+    @param  timeout   Timeout in ms before giving up (0 waits forever)
+*/
+/**************************************************************************/
+bool PN532_I2C::waitReadData(uint8_t* buff, uint8_t n, uint16_t timeout) {
+	uint32_t start = millis();
+	int32_t idle;
+	int32_t remaining = 0;
+	
+	while (!readWhenReady(buff, n)) {
+		#ifdef PN532_TRANSPORT_SHORT_READS
+			// The bus cannot take that many bytes: reading again won't help
+			if (_transport.shortRead()) return false;
+		#endif
+		if (timeout != 0) {
+			// Time left, 0 or less once the timeout has passed
+			remaining = (int32_t)timeout - (int32_t)(millis() - start);
+			if (remaining <= 0) return false;
+		}
+		if (_pin_irq == PN532_NO_IRQ) {
+			// Sleep until the next status read is due
+			idle = (int32_t)(_poll_next - micros());
+			if (idle > PN532_POLL_MAX_US) idle = PN532_POLL_MAX_US;
+			if (idle > 0) delayMicroseconds(idle);
 		} else {
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.println("PN532_I2C::checkForEZLink: ERROR - Unexpected response to EZLink search");
+			#ifdef PN532_LINUX
+				// Sleep until the IRQ line falls instead of spinning
+				pn532_linux_waitfalling(_pin_irq, (uint16_t)remaining);
 			#endif
-			return false;
-		} 
-	} else {
+		}
+	}
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Searches for an EZLink card, reads its purse and optionally
+            its transaction history, and releases it. A failed read or
+            release is retried on its own, without searching again. A
+            card that could not be read, or extra targets found, are
+            released too.
+
+    @param  purse     Receives the purse (CAN, balance, ...)
+    @param  history   Receives the last transactions, newest first (optional)
+    @param  count     Number of transactions wanted
+    @param  found     Receives the number of transactions read
+
+    @returns  true if a card was read (getLastError() tells why not)
+*/
+/**************************************************************************/
+bool PN532_I2C::checkForEZLink(PN532_Purse * purse, PN532_PurseTransaction * history, uint8_t count, uint8_t * found) {
+	PN532_Status status;
+	uint8_t retry;
+
+	#ifdef PN532_EZLINK_DEBUG 
+		Serial.println(F("PN532_I2C::checkForEZLink: Searching for EZLink Cards around"));
+	#endif
+
+	status = sendFrameReadResponse(pn532frame_inlist_ezlink, sizeof(pn532frame_inlist_ezlink),
+		PN532_RESPONSE_INLISTPASSIVETARGET, PN532_TIMEOUT_ADAPTIVE);
+	if (status == PN532_OK && _frame.getPayload()[0] != 1) {
+		#ifdef PN532_EZLINK_DEBUG
+			Serial.print(F("PN532_I2C::checkForEZLink: ERROR - Expected 1 tag (Total: "));
+			Serial.print(_frame.getPayload()[0]);
+			Serial.println(F(")"));
+		#endif
+		// Do not leave the targets found listed
+		if (_frame.getPayload()[0] > 0) releaseTarget(0);
+		status = _last_error = PN532_ERROR_TARGET;
+	}
+	if (status != PN532_OK) {
 		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Preamble missing in response");
+			Serial.print(F("PN532_I2C::checkForEZLink: ERROR - Search failed: "));
+			Serial.println(status);
 		#endif
 		return false;
 	}
+	
+	inListedTag = _frame.getPayload()[1];
+	#ifdef PN532_EZLINK_DEBUG
+		Serial.print(F("PN532_I2C::checkForEZLink: Found Tag number: "));
+		Serial.println(inListedTag);
+	#endif
 
-	pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-	pn532_packetbuffer[1] = 1;
-	pn532_packetbuffer[2] = 144;//90;
-	pn532_packetbuffer[3] = 50;//32;
-	pn532_packetbuffer[4] = 3;
-	pn532_packetbuffer[5] = 0;
-	pn532_packetbuffer[6] = 0;
-	pn532_packetbuffer[7] = 0;
-
-	if (!sendCommandCheckAck(pn532_packetbuffer, 8)){//, 1000)) {
+	for (retry = 0; retry <= PN532_EZLINK_RETRIES; retry++) {
+		status = sendFrameReadResponse(pn532frame_read_ezlink, sizeof(pn532frame_read_ezlink),
+			PN532_RESPONSE_INDATAEXCHANGE, PN532_TIMEOUT_ADAPTIVE);
+		if (status == PN532_OK && decodeEZLink(purse)) break;
+		status = _last_error;
 		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Could not read EZLink data.");
+			Serial.print(F("PN532_I2C::checkForEZLink: ERROR - Read failed: "));
+			Serial.println(status);
 		#endif
+		// The same response won't fit any better the next time
+		if (status == PN532_ERROR_OVERFLOW) break;
+	}
+	if (status != PN532_OK) {
+		// Give the card up, keeping the read error
+		releaseTarget(0);
+		_last_error = status;
 		return false;
 	}
 	
-	if (!waitUntilReady(1000)) {
+	// Same session: no need to search for the card again
+	if (history != 0 && count > 0) {
+		count = readEZLinkHistory(inListedTag, history, count);
+		if (found) *found = count;
+	}
+	
+	for (retry = 0; retry <= PN532_EZLINK_RETRIES; retry++) {
+		status = sendFrameReadResponse(pn532frame_release_ezlink, sizeof(pn532frame_release_ezlink),
+			PN532_RESPONSE_INRELEASE, PN532_TIMEOUT_ADAPTIVE);
+		if (status == PN532_OK) status = checkCardStatus();
+		if (status == PN532_OK) break;
 		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Chip timedout");
+			Serial.print(F("PN532_I2C::checkForEZLink: ERROR - Release failed: "));
+			Serial.println(status);
 		#endif
-		return false;
 	}
-	wirereaddata(pn532_packetbuffer, 64);
-	//memcpy(fullanswer, pn532_packetbuffer, 64);
-	//printbuffer(pn532_packetbuffer, 64);
-	// 00 01 02 03 04 05 06 07 08 09 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24
-	// 00 00 FF 64 9C D5 41 00 02 01 00 0D E2 00 00 00 11 11 73 20 30 96 26 14 A2 0E 22 CC FF 14 14 FF FF
-	//                                               ->                       <-
-	// DBS card
-	// 00 00 FF 64 9C D5 41 00 02 01 00 0D E2 00 00 00 11 11 73 20 30 96 26 14 A2 0E 22 CC FF 14 14 FF FF
-	//                                                 XX XX XX XX XX XX XX XX 
-	if (pn532_packetbuffer[0] == 0 &&
-		pn532_packetbuffer[1] == 0 &&
-		pn532_packetbuffer[2] == 0xff) {
-		uint8_t length = pn532_packetbuffer[3];
-		if (pn532_packetbuffer[4]!=(uint8_t)(~length+1)) {
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.print("PN532_I2C::checkForEZLink: ERROR - Invalid length from checking the incoming message (0x");
-				Serial.print(print8bitHex(length)); Serial.print(" / 0x");
-				Serial.print(print8bitHex(uint8_t(~length + 1)));
-				Serial.println(")");
+	if (status != PN532_OK) return false;
+	
+	#ifdef PN532_EZLINK_DEBUG
+		Serial.println(F("PN532_I2C::checkForEZLink: EZLink released"));
+	#endif
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Former checkForEZLink(), deprecated: use the PN532_Purse one
+
+    @param  ezlink    Receives the CAN, 8 bytes
+    @param  balance   Receives the balance in dollars
+*/
+/**************************************************************************/
+bool PN532_I2C::checkForEZLink(uint8_t * ezlink, float * balance) {
+	PN532_Purse purse;
+	
+	if (!checkForEZLink(&purse)) return false;
+	memcpy(ezlink, purse.can, 8);
+	*balance = purse.balance / 100.0;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Checks with a Diagnose presence test that the listed card is
+            still in the field, without reading it again
+*/
+/**************************************************************************/
+bool PN532_I2C::isCardPresent(void) {
+	uint8_t cmd[2] = { PN532_COMMAND_DIAGNOSE, PN532_DIAGNOSE_PRESENCE };
+	
+	if (sendCommandReadResponse(cmd, 2, PN532_RESPONSE_DIAGNOSE, PN532_TIMEOUT_ADAPTIVE) != PN532_OK) return false;
+	return checkCardStatus() == PN532_OK;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reports EZLink cards arriving and leaving, to be called
+            repeatedly. A card is read once when it arrives and then kept
+            listed: while it stays on the reader, each call only runs a
+            cheap presence test. A card lifted off and back within the
+            hold time (setPresenceHold()) is not reported again. A card
+            swapped for another one within the hold time is reported
+            PN532_CARD_GONE, then the new one PN532_CARD_NEW on the next
+            call.
+            Use PN532_RF_PRESET_FAST_POLL so that an empty field does not
+            block the search.
+
+    @param  purse     Receives the purse of a new card
+
+    @returns  PN532_CARD_NEW with purse filled, PN532_CARD_GONE once the
+              card has been away for the hold time or was swapped,
+              PN532_CARD_NONE otherwise
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::watchEZLink(PN532_Purse * purse) {
+	PN532_Status status;
+	
+	if (_presence_pending) {
+		// The card found in place of the one reported gone: read it
+		// again for its NEW, the purse was not kept
+		_presence_pending = false;
+		if (readEZLink(inListedTag, purse)) {
+			_presence_seen = millis();
+			#ifdef PN532_I2C_EVENTS
+				postArrivalEvents(purse, _event_detected);
 			#endif
-			return false;
+			return PN532_CARD_NEW;
 		}
-		if (pn532_packetbuffer[5] == PN532_PN532TOHOST && // D5
-			pn532_packetbuffer[6] == PN532_RESPONSE_INDATAEXCHANGE && // 41
-			pn532_packetbuffer[7] == 0 // OK (1 = Error)
-			) {
-				//if (pn532_packetbuffer[16] == 0x94) printbuffer(pn532_packetbuffer, 64);
-				//for (int i = 0; i < 8; i ++) {
-				//	ezlink[i] = pn532_packetbuffer[i + 16];
-				//	//Serial.print(printHex(pn532_packetbuffer[i + 16], 2));
-				//}
-				memcpy(ezlink, pn532_packetbuffer + 16, 8);
-				*balance = (float)(pn532_packetbuffer[11] * 256 + pn532_packetbuffer[12]) / 100;
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.print("PN532_I2C::checkForEZLink: EZLink CAN:");
-					for (int i = 0; i < 8; i ++) {
-						Serial.print(" "); Serial.print(print8bitHex(ezlink[i]));
-					}
-					Serial.print(" with balance of ");
-					Serial.println(*balance);
-				#endif
-		} else {
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.println("PN532_I2C::checkForEZLink: ERROR - Unexpected response to EZLink read");
+		#ifdef PN532_I2C_EVENTS
+			postEvent(PN532_EVENT_ERROR, _last_error, micros(), 0, 0);
+		#endif
+		releaseTarget(inListedTag);
+		_presence_listed = false;
+		_presence_valid = false;
+	}
+	
+	if (_presence_listed) {
+		if (isCardPresent()) {
+			_presence_seen = millis();
+			return PN532_CARD_NONE;
+		}
+		releaseTarget(inListedTag);
+		_presence_listed = false;
+	}
+	
+	status = sendFrameReadResponse(pn532frame_inlist_ezlink, sizeof(pn532frame_inlist_ezlink),
+		PN532_RESPONSE_INLISTPASSIVETARGET, PN532_TIMEOUT_ADAPTIVE);
+	if (status == PN532_OK && _frame.getPayload()[0] == 1) {
+		#ifdef PN532_I2C_EVENTS
+			_event_detected = _irq_interrupt ? _irq_micros : micros();
+		#endif
+		inListedTag = _frame.getPayload()[1];
+		if (readEZLink(inListedTag, purse)) {
+			bool same = _presence_valid && memcmp(_presence_can, purse->can, 8) == 0;
+			bool held = _presence_valid && millis() - _presence_seen <= _presence_hold;
+			
+			#ifdef PN532_I2C_EVENTS
+				if (held && !same) {
+					postEvent(PN532_EVENT_CARD_REMOVED, PN532_OK, _event_detected, _presence_can, 0);
+				} else if (!held) {
+					postArrivalEvents(purse, _event_detected);
+				}
 			#endif
-			return false;
-		} 
-	} else {
-		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Preamble missing in response");
+			memcpy(_presence_can, purse->can, 8);
+			_presence_valid = true;
+			_presence_listed = true;
+			_presence_seen = millis();
+			if (held && !same) {
+				// Another card within the hold time: the old one is gone first
+				_presence_pending = true;
+				return PN532_CARD_GONE;
+			}
+			return (held && same) ? PN532_CARD_NONE : PN532_CARD_NEW;
+		}
+		#ifdef PN532_I2C_EVENTS
+			postEvent(PN532_EVENT_ERROR, _last_error, micros(), 0, 0);
 		#endif
-		return false;
+		releaseTarget(inListedTag);
+	}
+	
+	if (_presence_valid && millis() - _presence_seen > _presence_hold) {
+		_presence_valid = false;
+		#ifdef PN532_I2C_EVENTS
+			postEvent(PN532_EVENT_CARD_REMOVED, PN532_OK, micros(), _presence_can, 0);
+		#endif
+		return PN532_CARD_GONE;
 	}
+	return PN532_CARD_NONE;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Puts the PN532 into PowerDown: RF field off, a few uA. The
+            next command wakes it up again, paying PN532_WAKE_DELAY once.
+            A listed target is released by the PN532.
+
+    @param  wakeup    PN532_WAKEUP_* sources allowed to wake the PN532,
+                      the bus in use by default
+
+    @returns  true if the PN532 went to sleep
+*/
+/**************************************************************************/
+bool PN532_I2C::powerDown(uint8_t wakeup) {
+	uint8_t cmd[2] = { PN532_COMMAND_POWERDOWN, wakeup };
+	
+	if (sendCommandReadResponse(cmd, 2, PN532_RESPONSE_POWERDOWN, PN532_TIMEOUT_ADAPTIVE) != PN532_OK) return false;
+	if (checkCardStatus() != PN532_OK) return false;
+	
+	_asleep = true;
+	_presence_listed = false;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sets the bounds of the pollLowPower() interval
+
+    @param  fast      Interval in ms while a card is on the reader or just
+                      left it
+    @param  slow      Longest interval in ms, reached after a while idle
+*/
+/**************************************************************************/
+void PN532_I2C::setDutyCycle(uint16_t fast, uint16_t slow) {
+	_power_fast = fast;
+	_power_slow = slow < fast ? fast : slow;
+	_power_interval = fast;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  watchEZLink() for battery powered readers, to be called from
+            loop(). Polls only once per interval and keeps the PN532 in
+            PowerDown between polls while no card is on the reader. The
+            interval is the fast one after a card was seen, then grows by
+            half at each empty poll up to the slow one (setDutyCycle()).
+            Use PN532_RF_PRESET_FAST_POLL so that an empty poll is short.
+
+    @param  purse     Receives the purse of a new card
+
+    @returns  As watchEZLink(), PN532_CARD_NONE between polls
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::pollLowPower(PN532_Purse * purse) {
+	uint8_t event;
 	
-	pn532_packetbuffer[0] = PN532_COMMAND_INRELEASE;
-	pn532_packetbuffer[1] = 1;
+	if (millis() - _power_last < _power_interval) return PN532_CARD_NONE;
+	
+	event = watchEZLink(purse);
+	_power_last = millis();
+	
+	if (_presence_listed || event != PN532_CARD_NONE) {
+		_power_interval = _power_fast;
+	} else {
+		_power_interval += _power_interval / 2;
+		if (_power_interval > _power_slow) _power_interval = _power_slow;
+	}
+	
+	// The presence test of a listed card needs the PN532 awake
+	if (!_presence_listed) powerDown();
+	return event;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Time until pollLowPower() polls again, for the application
+            to put the MCU to sleep meanwhile
+
+    @returns  Time in ms, 0 if the next call polls
+*/
+/**************************************************************************/
+uint16_t PN532_I2C::getIdleTime(void) {
+	uint32_t elapsed = millis() - _power_last;
+	
+	if (elapsed >= _power_interval) return 0;
+	return _power_interval - elapsed;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Starts a command without waiting for its response.
+            Progress is made by calling poll() from loop().
+
+    @param  cmd       Pointer to the command buffer
+    @param  cmdlen    The size of the command in bytes 
+    @param  callback  Called by poll() when the command completes (optional)
+    @param  timeout   Time in ms allowed for the response (0 waits forever,
+                      PN532_TIMEOUT_ADAPTIVE: learned deadline)
+
+    @returns  false if another command is still in progress
+*/
+/**************************************************************************/
+bool PN532_I2C::submit(uint8_t *cmd, uint8_t cmdlen, PN532_I2C_Callback callback, uint16_t timeout) {
+	if (_async_state != PN532_STAGE_IDLE) return false;
+	
+	wiresendcommand(cmd, cmdlen);
+	beginAsync(callback, timeout);
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Same as submit(), for a frame prebuilt with the
+            PN532_FRAME_START / PN532_FRAME_END macros
+
+    @param  frame     Pointer to the frame, in PROGMEM
+    @param  framelen  The size of the frame in bytes 
+    @param  callback  Called by poll() when the command completes (optional)
+    @param  timeout   Time in ms allowed for the response (0 waits forever,
+                      PN532_TIMEOUT_ADAPTIVE: learned deadline)
+*/
+/**************************************************************************/
+bool PN532_I2C::submitFrame(const uint8_t *frame, uint8_t framelen, PN532_I2C_Callback callback, uint16_t timeout) {
+	if (_async_state != PN532_STAGE_IDLE) return false;
+	
+	wiresendframe_P(frame, framelen);
+	beginAsync(callback, timeout);
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Starts tracking the command just sent
+*/
+/**************************************************************************/
+void PN532_I2C::beginAsync(PN532_I2C_Callback callback, uint16_t timeout) {
+	_command_adaptive = (timeout == PN532_TIMEOUT_ADAPTIVE);
+	if (_command_adaptive) timeout = getTimeout(_command);
+	if (timeout == 0) _command = 0xFF;
+	
+	_async_callback = callback;
+	_async_timeout = timeout;
+	_async_framelen = 0;
+	_async_start = millis();
+	_async_state = PN532_STAGE_WAIT_ACK;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Makes progress on the submitted command. Never does more than
+            one transfer per call.
+
+    @returns  PN532_ASYNC_BUSY while the command is in progress, then
+              PN532_ASYNC_DONE or PN532_ASYNC_ERROR exactly once, and
+              PN532_ASYNC_IDLE when nothing was submitted
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::poll(void) {
+	uint8_t len;
+	
+	switch (_async_state) {
+		case PN532_STAGE_IDLE:
+			return PN532_ASYNC_IDLE;
+		case PN532_STAGE_SEND_NACK:
+			// Ask the PN532 to resend the frame, now that its length is known
+			wiresendnack();
+			_async_start = millis();
+			_async_state = PN532_STAGE_WAIT_RESEND;
+			return PN532_ASYNC_BUSY;
+		#ifdef PN532_TRANSPORT_STREAM
+		case PN532_STAGE_WAIT_REST:
+			// Take the bytes as they arrive: the frame can be longer than
+			// the UART buffer
+			len = wirereadavailable(_packetbuffer + _async_got, _async_framelen - _async_got);
+			if (len > 0) {
+				_async_got += len;
+				_async_start = millis();
+			}
+			if (_async_got < _async_framelen) {
+				if (millis() - _async_start > PN532_HSU_TIMEOUT) return finish(PN532_ERROR_TIMEOUT);
+				return PN532_ASYNC_BUSY;
+			}
+			#ifdef PN532_I2C_STATS
+				recordStats(PN532_STATS_READ);
+			#endif
+			return finish(_frame.parse(_packetbuffer, _async_framelen));
+		#endif
+	}
+	
+	// ACK, response header, or the full resent response
+	switch (_async_state) {
+		case PN532_STAGE_WAIT_ACK:      len = 6; break;
+		case PN532_STAGE_WAIT_RESPONSE: len = 5; break;
+		default:                        len = _async_framelen; break;
+	}
+	
+	if (!readWhenReady(_packetbuffer, len)) {
+		if (_async_state == PN532_STAGE_WAIT_RESEND) {
+			#ifdef PN532_TRANSPORT_SHORT_READS
+				if (_transport.shortRead()) return finish(PN532_ERROR_OVERFLOW);
+			#endif
+			if (millis() - _async_start > PN532_I2C_RESEND_TIMEOUT) return finish(PN532_ERROR_TIMEOUT);
+		} else if (_async_timeout != 0 && millis() - _async_start > _async_timeout) {
+			#ifdef PN532_I2C_DEBUG
+				Serial.println(F("PN532_I2C::poll: Command timed out"));
+			#endif
+			wiresendack();
+			backoffTimeout();
+			return finish(PN532_ERROR_TIMEOUT);
+		}
+		return PN532_ASYNC_BUSY;
+	}
+	
+	switch (_async_state) {
+		case PN532_STAGE_WAIT_ACK:
+			#ifdef PN532_I2C_STATS
+				recordStats(PN532_STATS_ACK);
+			#endif
+			if (memcmp_P(_packetbuffer, pn532ack, 6) != 0) {
+				#ifdef PN532_I2C_DEBUG
+					Serial.println(F("PN532_I2C::poll: No ACK frame received!"));
+				#endif
+				return finish(PN532_ERROR_NACK);
+			}
+			_async_state = PN532_STAGE_WAIT_RESPONSE;
+			beginWait(true);
+			break;
+		case PN532_STAGE_WAIT_RESPONSE:
+			#ifdef PN532_I2C_STATS
+				recordStats(PN532_STATS_RESPONSE);
+			#endif
+			learnTimeout();
+			_async_framelen = pn532_framelength(_packetbuffer, _packetsize);
+			if (_async_framelen == 0) return finish(_frame.parse(_packetbuffer, 5));
+			#ifdef PN532_TRANSPORT_STREAM
+				// The rest of the frame follows the header
+				_async_got = 5;
+				_async_start = millis();
+				_async_state = PN532_STAGE_WAIT_REST;
+				break;
+			#else
+				_async_state = PN532_STAGE_SEND_NACK;
+				break;
+			#endif
+		case PN532_STAGE_WAIT_RESEND:
+			#ifdef PN532_I2C_STATS
+				recordStats(PN532_STATS_READ);
+			#endif
+			return finish(_frame.parse(_packetbuffer, _async_framelen));
+		default:
+			return finish(PN532_ERROR_TIMEOUT);
+	}
+	return PN532_ASYNC_BUSY;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Ends the submitted command and reports its result. A command
+            succeeds only with a fully validated response frame.
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::finish(PN532_Status status) {
+	_async_state = PN532_STAGE_IDLE;
+	_last_error = status;
+	#ifdef PN532_I2C_STATS
+		recordError(status);
+	#endif
+	if (status != PN532_OK) _async_framelen = 0;
+	
+	if (_async_callback) {
+		_async_callback(this, (status == PN532_OK) ? _packetbuffer : 0, _async_framelen);
+	}
+	return (status == PN532_OK) ? PN532_ASYNC_DONE : PN532_ASYNC_ERROR;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Aborts the submitted command. An ACK frame tells the PN532 to
+            drop the command in progress.
+*/
+/**************************************************************************/
+void PN532_I2C::abort(void) {
+	if (_async_state == PN532_STAGE_IDLE) return;
+	
+	wiresendack();
+	
+	_async_state = PN532_STAGE_IDLE;
+	_async_framelen = 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Returns the response frame of the last completed command
+*/
+/**************************************************************************/
+uint8_t * PN532_I2C::getResponse(void) {
+	return _packetbuffer;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Checks the status byte of the last response (see
+            PN532_FrameView::checkStatus) and keeps the result for
+            getLastError()
+*/
+/**************************************************************************/
+PN532_Status PN532_I2C::checkCardStatus(void) {
+	_last_error = _frame.checkStatus();
+	#ifdef PN532_I2C_STATS
+		recordError(_last_error);
+	#endif
+	return _last_error;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads a big endian signed 24 bit CEPAS amount
+*/
+/**************************************************************************/
+static int32_t pn532_purseamount(const uint8_t * data) {
+	int32_t amount = ((int32_t)data[0] << 16) | ((uint16_t)data[1] << 8) | data[2];
+	
+	if (amount & 0x800000L) amount -= 0x1000000L;
+	return amount;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Decodes a 16 bytes CEPAS transaction record
+*/
+/**************************************************************************/
+static void pn532_pursetransaction(const uint8_t * data, PN532_PurseTransaction * transaction) {
+	transaction->type = data[0];
+	transaction->amount = pn532_purseamount(data + 1);
+	transaction->datetime = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) |
+		((uint16_t)data[6] << 8) | data[7];
+	memcpy(transaction->user, data + 8, 8);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Decodes the purse from the InDataExchange response to the
+            CEPAS read purse APDU
+*/
+/**************************************************************************/
+bool PN532_I2C::decodeEZLink(PN532_Purse * purse) {
+	uint8_t * data;
+	uint8_t len;
+	
+	if (_frame.getResponseCode() != PN532_RESPONSE_INDATAEXCHANGE) {
+		_last_error = PN532_ERROR_RESPONSE;
+		return false;
+	}
+	if (checkCardStatus() != PN532_OK) return false;
+	
+	// Payload: InDataExchange status, purse data, SW1 SW2
+	data = _frame.getPayload() + 1;
+	len = _frame.getPayloadLength() - 1;
+	if (len < 2 || data[len - 2] != 0x90 || data[len - 1] != 0x00) {
+		_last_error = PN532_ERROR_CARD;
+		return false;
+	}
+	if (len - 2 < PN532_PURSE_LENGTH) {
+		_last_error = PN532_ERROR_RESPONSE;
+		return false;
+	}
+	
+	// 0 version, 1 status, 2-4 balance, 5-7 auto-load amount, 8-15 CAN,
+	// 16-23 CSN, 24-25 expiry, 26-27 creation, 28-45 last credit and
+	// log details, 46-61 last transaction record
+	purse->version = data[0];
+	purse->status = data[1];
+	purse->balance = pn532_purseamount(data + 2);
+	purse->autoload = pn532_purseamount(data + 5);
+	memcpy(purse->can, data + 8, 8);
+	memcpy(purse->csn, data + 16, 8);
+	purse->expiry = ((uint16_t)data[24] << 8) | data[25];
+	purse->created = ((uint16_t)data[26] << 8) | data[27];
+	pn532_pursetransaction(data + 46, &purse->last);
+	
+	#ifdef PN532_EZLINK_DEBUG
+		Serial.print(F("PN532_I2C::checkForEZLink: EZLink CAN:"));
+		for (int i = 0; i < 8; i ++) {
+			Serial.print(F(" ")); print8bitHex(Serial, purse->can[i]);
+		}
+		Serial.print(F(" with balance of "));
+		Serial.print(purse->balance);
+		Serial.println(F(" cents"));
+	#endif
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Lists up to two targets in the field with a single
+            InListPassiveTarget
+
+    @param  brty        Baud rate and modulation (PN532_TARGET_GENERIC_106A,
+                        PN532_TARGET_FELICA_212/424, PN532_TARGET_GENERIC_106B,
+                        PN532_TARGET_JEWEL)
+    @param  targets     Receives the targets found
+    @param  maxtargets  Size of the targets array (1 or 2)
+    @param  timeout     Time in ms allowed for the search, learned by
+                        default (PN532_TIMEOUT_ADAPTIVE)
+
+    @returns  The number of targets stored in targets. They stay selected
+              for dataExchange() until releaseTarget().
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::listTargets(uint8_t brty, PN532_Target *targets, uint8_t maxtargets, uint16_t timeout) {
+	uint8_t cmd[3 + PN532_FELICA_POLLING_LENGTH];
+	uint8_t * payload;
+	uint8_t len, pos, used, found, cmdlen;
+	
+	if (maxtargets > PN532_MAX_TARGETS) maxtargets = PN532_MAX_TARGETS;
+	if (maxtargets == 0) return 0;
+	
+	cmd[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+	cmd[1] = maxtargets;
+	cmd[2] = brty;
+	cmdlen = 3;
+	
+	switch (brty) {
+		case PN532_TARGET_GENERIC_106B:
+			cmd[cmdlen++] = 0x00; // AFI, all application families
+			break;
+		case PN532_TARGET_FELICA_212:
+		case PN532_TARGET_FELICA_424:
+			// Payload of the FeliCa POLLING request: any system code,
+			// system code requested, one time slot
+			memcpy_P(cmd + cmdlen, pn532_felica_polling, PN532_FELICA_POLLING_LENGTH);
+			cmdlen += PN532_FELICA_POLLING_LENGTH;
+			break;
+	}
+	
+	if (sendCommandReadResponse(cmd, cmdlen, PN532_RESPONSE_INLISTPASSIVETARGET, timeout) != PN532_OK) {
+		return 0;
+	}
+	
+	// NbTg, then the target data of each target, back to back
+	payload = _frame.getPayload();
+	len = _frame.getPayloadLength();
+	found = 0;
+	pos = 1;
+	while (len > 0 && found < payload[0] && found < maxtargets && pos < len) {
+		used = pn532_parsetarget(brty, payload + pos, len - pos, &targets[found]);
+		if (used == 0) break;
+		pos += used;
+		found++;
+	}
+	
+	if (found > 0) inListedTag = targets[0].tg;
+	return found;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sends data to a listed target with InDataExchange. On success
+            the card answer is at getFrame()->getPayload() + 1, and is
+            getFrame()->getPayloadLength() - 1 bytes long.
+
+    @param  tg        Target number (PN532_Target::tg)
+    @param  data      Data to send (e.g. an APDU)
+    @param  len       Number of bytes, at most PN532_DATAEXCHANGE_MAXLEN
+    @param  timeout   Time in ms allowed for the answer, learned by
+                      default (PN532_TIMEOUT_ADAPTIVE)
+*/
+/**************************************************************************/
+PN532_Status PN532_I2C::dataExchange(uint8_t tg, const uint8_t *data, uint8_t len, uint16_t timeout) {
+	uint8_t cmd[2 + PN532_DATAEXCHANGE_MAXLEN];
+	
+	if (len > PN532_DATAEXCHANGE_MAXLEN) return _last_error = PN532_ERROR_OVERFLOW;
+	
+	cmd[0] = PN532_COMMAND_INDATAEXCHANGE;
+	cmd[1] = tg;
+	memcpy(cmd + 2, data, len);
+	
+	if (sendCommandReadResponse(cmd, 2 + len, PN532_RESPONSE_INDATAEXCHANGE, timeout) != PN532_OK) {
+		return _last_error;
+	}
+	return checkCardStatus();
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Releases a listed target
+
+    @param  tg        Target number, 0 to release all targets
+*/
+/**************************************************************************/
+bool PN532_I2C::releaseTarget(uint8_t tg) {
+	uint8_t cmd[2] = { PN532_COMMAND_INRELEASE, tg };
+	
+	if (sendCommandReadResponse(cmd, 2, PN532_RESPONSE_INRELEASE, PN532_TIMEOUT_ADAPTIVE) != PN532_OK) return false;
+	return checkCardStatus() == PN532_OK;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads the purse of an EZLink card already listed by
+            listTargets(PN532_TARGET_GENERIC_106B, ...)
+
+    @param  tg        Target number (PN532_Target::tg)
+    @param  purse     Receives the purse
+*/
+/**************************************************************************/
+bool PN532_I2C::readEZLink(uint8_t tg, PN532_Purse * purse) {
+	static const uint8_t apdu[] = { 0x90, 0x32, 0x03, 0x00, 0x00, 0x00 };
+	
+	if (dataExchange(tg, apdu, sizeof(apdu)) != PN532_OK) return false;
+	return decodeEZLink(purse);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads the transaction history of an EZLink card already
+            listed, as many records per InDataExchange as the receive
+            buffer holds
+            (CEPAS read purse record APDU: 90 32 03 00 01 <first> <len>)
+
+    @param  tg        Target number (PN532_Target::tg)
+    @param  history   Receives the transactions, newest first
+    @param  count     Number of transactions wanted, at most
+                      PN532_HISTORY_MAX
+
+    @returns  The number of transactions read: less than count if the
+              card holds fewer, or on error (see getLastError()). 0 with
+              PN532_ERROR_OVERFLOW if the receive buffer is smaller than
+              PN532_HISTORY_BUFSIZ.
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::readEZLinkHistory(uint8_t tg, PN532_PurseTransaction * history, uint8_t count) {
+	uint8_t apdu[] = { 0x90, 0x32, 0x03, 0x00, 0x01, 0x00, 0x00 };
+	uint8_t done = 0;
+	uint8_t most;
+	uint8_t batch, records, len, retry;
+	uint8_t * data;
+	
+	// Not even one record fits the receive buffer
+	if (_packetsize < PN532_HISTORY_BUFSIZ) {
+		_last_error = PN532_ERROR_OVERFLOW;
+		return 0;
+	}
+	most = PN532_HISTORY_BATCH(_packetsize);
+	if (count > PN532_HISTORY_MAX) count = PN532_HISTORY_MAX;
+	
+	while (done < count) {
+		batch = count - done;
+		if (batch > most) batch = most;
+		apdu[5] = done;
+		apdu[6] = batch * 16;
+		
+		for (retry = 0; retry <= PN532_EZLINK_RETRIES; retry++) {
+			if (dataExchange(tg, apdu, sizeof(apdu)) == PN532_OK) break;
+		}
+		if (retry > PN532_EZLINK_RETRIES) break;
+		
+		// Card answer: records, SW1 SW2
+		data = _frame.getPayload() + 1;
+		len = _frame.getPayloadLength() - 1;
+		if (len < 2 || data[len - 2] != 0x90 || data[len - 1] != 0x00) {
+			_last_error = PN532_ERROR_CARD;
+			break;
+		}
+		
+		records = (len - 2) / 16;
+		for (uint8_t i=0; i<records && done<count; i++) {
+			pn532_pursetransaction(data + i * 16, &history[done++]);
+		}
+		// No more records on the card
+		if (records < batch) break;
+	}
+	return done;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sets one RFConfiguration item
+
+    @param  item      PN532_RFCFG_*
+    @param  data      Values of the item
+    @param  len       Number of values (at most 3)
+*/
+/**************************************************************************/
+bool PN532_I2C::rfConfiguration(uint8_t item, const uint8_t *data, uint8_t len) {
+	uint8_t cmd[5];
+	
+	cmd[0] = PN532_COMMAND_RFCONFIGURATION;
+	cmd[1] = item;
+	memcpy(cmd + 2, data, len);
+	
+	return (sendCommandReadResponse(cmd, 2 + len, PN532_RESPONSE_RFCONFIGURATION, PN532_TIMEOUT_ADAPTIVE) == PN532_OK);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Switches the RF field on or off
+
+    @param  on        true to switch the field on
+    @param  autorfca  Enables RF collision avoidance
+*/
+/**************************************************************************/
+bool PN532_I2C::setRFField(bool on, bool autorfca) {
+	uint8_t data = (on ? 0x01 : 0x00) | (autorfca ? 0x02 : 0x00);
+	
+	return rfConfiguration(PN532_RFCFG_FIELD, &data, 1);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sets the ATR_RES timeout and the timeout of InCommunicateThru
+            and InDataExchange retries. Each value n stands for
+            100 us * 2^(n-1) (0x0B = 102.4 ms, the highest is 0x10).
+*/
+/**************************************************************************/
+bool PN532_I2C::setRFTimings(uint8_t atr_res_timeout, uint8_t retry_timeout) {
+	uint8_t data[3] = { 0x00, atr_res_timeout, retry_timeout };
+	
+	return rfConfiguration(PN532_RFCFG_TIMINGS, data, 3);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sets how often the PN532 retries ATR_REQ, PSL_REQ and the
+            passive activation of InListPassiveTarget. 0xFF retries
+            forever, which is the chip default for passive activation.
+*/
+/**************************************************************************/
+bool PN532_I2C::setMaxRetries(uint8_t atr, uint8_t psl, uint8_t passive_activation) {
+	uint8_t data[3] = { atr, psl, passive_activation };
+	
+	return rfConfiguration(PN532_RFCFG_MAXRETRIES, data, 3);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sets how often the PN532 retries a failed InDataExchange
+            (MaxRtyCOM, chip default 0)
+*/
+/**************************************************************************/
+bool PN532_I2C::setMaxRetryCOM(uint8_t retries) {
+	return rfConfiguration(PN532_RFCFG_MAXRTYCOM, &retries, 1);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Applies a set of RF retries and timings
+
+    @param  preset    PN532_RF_PRESET_DEFAULT: chip defaults, detection
+                      waits until a card shows up.
+                      PN532_RF_PRESET_FAST_POLL: a single passive
+                      activation, a search without card ends within
+                      a few milliseconds.
+                      PN532_RF_PRESET_ROBUST_READ: a few activations,
+                      long timeouts and InDataExchange retries, for
+                      cards that are slow or far from the antenna.
+*/
+/**************************************************************************/
+bool PN532_I2C::applyRFPreset(uint8_t preset) {
+	// The card side latencies learned so far no longer hold
+	resetTimeouts();
+	
+	switch (preset) {
+		case PN532_RF_PRESET_DEFAULT:
+			return setMaxRetries(0xFF, 0x01, 0xFF) &&
+				setRFTimings(0x0B, 0x0A) &&
+				setMaxRetryCOM(0x00);
+		case PN532_RF_PRESET_FAST_POLL:
+			return setMaxRetries(0x01, 0x01, 0x01) &&
+				setRFTimings(0x08, 0x08) &&
+				setMaxRetryCOM(0x00);
+		case PN532_RF_PRESET_ROBUST_READ:
+			return setMaxRetries(0x05, 0x02, 0x08) &&
+				setRFTimings(0x0B, 0x0B) &&
+				setMaxRetryCOM(0x03);
+	}
+	return false;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Lets the PN532 look for cards on its own (InAutoPoll). The
+            PN532 only raises IRQ once a card is found, so waiting costs
+            no I2C traffic. Collect the result with pollAutoPoll().
+
+    @param  types     Target types to look for (PN532_TARGET_*), 1 to 15
+    @param  ntypes    Number of types
+    @param  pollnr    Number of polling rounds, 0xFF for endless polling
+    @param  period    Time between rounds, in units of 150 ms
+
+    @returns  false if another command is still in progress
+*/
+/**************************************************************************/
+bool PN532_I2C::startAutoPoll(const uint8_t *types, uint8_t ntypes, uint8_t pollnr, uint8_t period) {
+	uint8_t cmd[3 + 15];
+	uint32_t timeout;
+	
+	if (ntypes == 0 || ntypes > 15) return false;
+	
+	cmd[0] = PN532_COMMAND_INAUTOPOLL;
+	cmd[1] = pollnr;
+	cmd[2] = period;
+	memcpy(cmd + 3, types, ntypes);
+	
+	// Endless polling ends only when a card shows up
+	timeout = 0;
+	if (pollnr != 0xFF) {
+		timeout = 1000 + (uint32_t)pollnr * period * 150 * ntypes;
+		// 0xFFFF would ask for the adaptive timeout
+		if (timeout > PN532_TIMEOUT_ADAPTIVE - 1) timeout = PN532_TIMEOUT_ADAPTIVE - 1;
+	}
+	return submit(cmd, 3 + ntypes, 0, (uint16_t)timeout);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Collects the result of startAutoPoll(), to be called from loop()
+
+    @param  targets     Receives the targets found
+    @param  maxtargets  Size of the targets array
+    @param  found       Receives the number of targets stored in targets
+
+    @returns  poll() result: PN532_ASYNC_BUSY while the PN532 is polling,
+              PN532_ASYNC_DONE once *found is valid (0 if the polling
+              rounds ended without a card)
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::pollAutoPoll(PN532_Target *targets, uint8_t maxtargets, uint8_t *found) {
+	uint8_t result;
+	uint8_t * payload;
+	uint8_t len, pos, nbtg;
+	
+	*found = 0;
+	
+	result = poll();
+	if (result != PN532_ASYNC_DONE) return result;
+	
+	if (_frame.getResponseCode() != PN532_RESPONSE_INAUTOPOLL || _frame.getPayloadLength() < 1) {
+		_last_error = PN532_ERROR_RESPONSE;
+		return PN532_ASYNC_ERROR;
+	}
+	
+	// NbTg, then Type, Len, TargetData for each target
+	payload = _frame.getPayload();
+	len = _frame.getPayloadLength();
+	nbtg = payload[0];
+	pos = 1;
+	for (uint8_t i=0; i<nbtg && *found<maxtargets && pos + 2 <= len; i++) {
+		uint8_t type = payload[pos];
+		uint8_t datalen = payload[pos + 1];
+		
+		pos += 2;
+		if (pos + datalen > len) break;
+		if (pn532_parsetarget(type, payload + pos, datalen, &targets[*found])) {
+			(*found)++;
+		}
+		pos += datalen;
+	}
+	
+	return PN532_ASYNC_DONE;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Registers a card protocol for readCard()
+
+    @param  type      Target type to poll for (PN532_TARGET_*), e.g.
+                      PN532_TARGET_ISO14443_4B for EZLink or
+                      PN532_TARGET_MIFARE for MIFARE Classic / Ultralight
+    @param  read      Called with each card of that type
+    @param  context   Passed to read, e.g. where to store what it read
+    @param  sakmask   Type A only: the handler takes the cards whose SAK
+    @param  sak       matches (sak & sakmask) == sak, e.g. 0x08 / 0x08
+                      for MIFARE Classic. Leave 0 / 0 to take all cards.
+
+    @returns  false if PN532_MAX_HANDLERS are already registered
+*/
+/**************************************************************************/
+bool PN532_I2C::addCardHandler(uint8_t type, PN532_CardReader read, void * context, uint8_t sakmask, uint8_t sak) {
+	PN532_CardHandler * handler;
+	
+	if (_nhandlers >= PN532_MAX_HANDLERS) return false;
+	
+	handler = &_handlers[_nhandlers++];
+	handler->type = type;
+	handler->sakmask = sakmask;
+	handler->sak = sak;
+	handler->read = read;
+	handler->context = context;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Non blocking card read, to be called from loop(). The first
+            call starts a single InAutoPoll for all the card types of the
+            registered handlers and returns; the next ones return at once
+            while the PN532 is polling. Once it found cards, the first
+            matching handler of every card is called, then the cards are
+            released and the next call polls again. The handlers and the
+            release block: that call takes as long as their commands.
+
+    @param  pollnr    Polling rounds (1 to 254, 0xFF polls until a card
+                      shows up)
+    @param  period    Time between rounds, in 150 ms units
 
-	if (!sendCommandCheckAck(pn532_packetbuffer, 2)){//, 1000)) {
-		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Could not release.");
-		#endif
-		return false;
-	}
+    @returns  The number of cards read by a handler, 0 while polling
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::readCard(uint8_t pollnr, uint8_t period) {
+	PN532_Target targets[PN532_MAX_TARGETS];
+	uint8_t types[PN532_MAX_HANDLERS];
+	uint8_t ntypes = 0;
+	uint8_t found, handled, result, i, j;
 	
-	if (!waitUntilReady(1000)) {
-		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Chip timedout");
-		#endif
-		return false;
+	if (!_card_polling) {
+		// Each type is polled once, whatever the number of handlers for it
+		for (i=0; i<_nhandlers; i++) {
+			for (j=0; j<ntypes && types[j] != _handlers[i].type; j++);
+			if (j == ntypes) types[ntypes++] = _handlers[i].type;
+		}
+		if (ntypes == 0) return 0;
+		
+		_card_polling = startAutoPoll(types, ntypes, pollnr, period);
+		return 0;
 	}
-	wirereaddata(pn532_packetbuffer, 64);
-	
-	if (pn532_packetbuffer[0] == 0 &&
-		pn532_packetbuffer[1] == 0 &&
-		pn532_packetbuffer[2] == 0xff) {
-		uint8_t length = pn532_packetbuffer[3];
-		if (pn532_packetbuffer[4]!=(uint8_t)(~length+1)) {
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.print("PN532_I2C::checkForEZLink: ERROR - Invalid length from checking the incoming message (0x");
-				Serial.print(print8bitHex(length)); Serial.print(" / 0x");
-				Serial.print(print8bitHex(uint8_t(~length + 1)));
-				Serial.println(")");
-			#endif
-			return false;
+	
+	result = pollAutoPoll(targets, PN532_MAX_TARGETS, &found);
+	if (result == PN532_ASYNC_BUSY) return 0;
+	_card_polling = false;
+	if (result != PN532_ASYNC_DONE || found == 0) return 0;
+	
+	handled = 0;
+	for (i=0; i<found; i++) {
+		for (j=0; j<_nhandlers; j++) {
+			PN532_CardHandler * handler = &_handlers[j];
+			
+			if (handler->type != targets[i].type) continue;
+			if ((targets[i].sak & handler->sakmask) != handler->sak) continue;
+			if (handler->read(this, &targets[i], handler->context)) handled++;
+			break;
 		}
-		if (pn532_packetbuffer[5] == PN532_PN532TOHOST && // D5
-			pn532_packetbuffer[6] == PN532_RESPONSE_INRELEASE && // 41
-			pn532_packetbuffer[7] == 0 // OK (1 = Error)
-			) {
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.println("PN532_I2C::checkForEZLink: EZLink released");
-				#endif
-		} else {
-			#ifdef PN532_EZLINK_DEBUG
-				Serial.println("PN532_I2C::checkForEZLink: ERROR - Unexpected response to release");
-			#endif
-			return false;
-		} 
-	} else {
-		#ifdef PN532_EZLINK_DEBUG
-			Serial.println("PN532_I2C::checkForEZLink: ERROR - Preamble missing in response");
-		#endif
-		return false;
 	}
+	
+	releaseTarget(0);
+	return handled;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Card handler reading an EZLink purse, for
+            addCardHandler(PN532_TARGET_ISO14443_4B, readEZLinkCard, &purse)
+
+    @param  purse     The PN532_Purse to fill
+*/
+/**************************************************************************/
+bool PN532_I2C::readEZLinkCard(PN532_I2C * reader, PN532_Target * target, void * purse) {
+	return reader->readEZLink(target->tg, (PN532_Purse *)purse);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Card handler keeping the identifier of a card, enough to tell
+            MIFARE Classic, Ultralight or DESFire cards apart by UID:
+
+            addCardHandler(PN532_TARGET_MIFARE, readCardUID, &classic, 0x08, 0x08)
+            addCardHandler(PN532_TARGET_MIFARE, readCardUID, &ultralight, 0xFF, 0x00)
+            addCardHandler(PN532_TARGET_ISO14443_4A, readCardUID, &desfire)
+
+    @param  copy      The PN532_Target to copy the card to
+*/
+/**************************************************************************/
+bool PN532_I2C::readCardUID(PN532_I2C * reader, PN532_Target * target, void * copy) {
+	(void)reader;
+	if (target->idlen == 0) return false;
+	
+	memcpy(copy, target, sizeof(PN532_Target));
 	return true;
 }
 
-bool PN532_I2C::checkForEZLink_Transparent(uint8_t * ezlink, float * balance) {
-	static uint8_t checkForEZLink_state = 0;
+/**************************************************************************/
+/*! 
+    @brief  Non blocking version of checkForEZLink, to be called from
+            loop(). Runs search, read and release one step per call on
+            the asynchronous engine.
+
+    @returns  true once per card, when the card was read and released.
+              A card that could not be read is released too, then the
+              read error is reported (getLastError(), PN532_EVENT_ERROR).
+*/
+/**************************************************************************/
+bool PN532_I2C::checkForEZLink_Transparent(PN532_Purse * purse) {
+	uint8_t result;
 	
-	switch (checkForEZLink_state) {
+	switch (_ezlink_state) {
 		case 0:
-			pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-			pn532_packetbuffer[1] = 1;
-			pn532_packetbuffer[2] = 3;
-			pn532_packetbuffer[3] = 0;
-			
 			#ifdef PN532_EZLINK_DEBUG 
-				Serial.println("PN532_I2C::checkForEZLink: Searching for EZLink Cards around");
+				Serial.println(F("PN532_I2C::checkForEZLink: Searching for EZLink Cards around"));
+			#endif
+			#ifdef PN532_I2C_EVENTS
+				checkCardRemoved();
 			#endif
 			
-			if (!sendCommandCheckAck(pn532_packetbuffer, 4, 100)) {
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.println("PN532_I2C::checkForEZLink: ERROR - NP532 is not responding");
-				#endif
-			} else {
-				checkForEZLink_state = 1;
+			// Wait as long as it takes for a card to show up
+			if (submitFrame(pn532frame_inlist_ezlink, sizeof(pn532frame_inlist_ezlink), 0, 0)) {
+				_ezlink_state = 1;
 			}
-			//wiresendcommand(pn532_packetbuffer, 4);
 			break;
 		case 1:
-			// Wait for NP532 to detect something that could be an EZLink
-			if ( wirereadstatus() == PN532_I2C_READY ) {
-				checkForEZLink_state = 2;
+			result = poll();
+			if (result == PN532_ASYNC_BUSY) {
+				#ifdef PN532_I2C_EVENTS
+					checkCardRemoved();
+				#endif
+				break;
 			}
-			break;
-		case 2:
-			wirereaddata(pn532_packetbuffer, sizeof(pn532_packetbuffer));
 			
-			if (pn532_packetbuffer[0] == 0 &&
-				pn532_packetbuffer[1] == 0 &&
-				pn532_packetbuffer[2] == 0xff &&
-				pn532_packetbuffer[4] == (uint8_t)(~pn532_packetbuffer[3] + 1) &&
-				pn532_packetbuffer[5] == PN532_PN532TOHOST &&
-				pn532_packetbuffer[6] == PN532_RESPONSE_INLISTPASSIVETARGET &&
-				pn532_packetbuffer[7] == 1) {
+			if (result == PN532_ASYNC_DONE &&
+				_frame.getResponseCode() == PN532_RESPONSE_INLISTPASSIVETARGET &&
+				_frame.getPayload()[0] == 1) {
+				#ifdef PN532_I2C_EVENTS
+					_event_detected = _irq_interrupt ? _irq_micros : micros();
+				#endif
 				#ifdef PN532_EZLINK_DEBUG
-					Serial.println("PN532_I2C::checkForEZLink: NP532 found an EZLink");
+					Serial.println(F("PN532_I2C::checkForEZLink: NP532 found an EZLink"));
 				#endif
-				checkForEZLink_state = 3;
+				_ezlink_retries = PN532_EZLINK_RETRIES;
+				_ezlink_error = PN532_OK;
+				_ezlink_state = 2;
 			} else {
-				checkForEZLink_state = 0;
+				_ezlink_state = 0;
 			}
 			break;
-		case 3:
-			pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-			pn532_packetbuffer[1] = 1;
-			pn532_packetbuffer[2] = 144;//90;
-			pn532_packetbuffer[3] = 50;//32;
-			pn532_packetbuffer[4] = 3;
-			pn532_packetbuffer[5] = 0;
-			pn532_packetbuffer[6] = 0;
-			pn532_packetbuffer[7] = 0;
-			
+		case 2:
 			#ifdef PN532_EZLINK_DEBUG 
-				Serial.println("PN532_I2C::checkForEZLink: Request read EZLink Card data");
+				Serial.println(F("PN532_I2C::checkForEZLink: Request read EZLink Card data"));
 			#endif
 			
-			if (!sendCommandCheckAck(pn532_packetbuffer, 8, 100)) {
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.println("PN532_I2C::checkForEZLink: ERROR - NP532 is not responding");
-				#endif
+			if (submitFrame(pn532frame_read_ezlink, sizeof(pn532frame_read_ezlink))) {
+				_ezlink_state = 3;
 			} else {
-				checkForEZLink_state = 4;
-			}
-			break;
-		case 4:
-			// Wait for card to reply to the read request
-			if ( wirereadstatus() == PN532_I2C_READY ) {
-				checkForEZLink_state = 5;
+				_ezlink_state = 0;
 			}
 			break;
-		case 5:
-			wirereaddata(pn532_packetbuffer, sizeof(pn532_packetbuffer));
+		case 3:
+			result = poll();
+			if (result == PN532_ASYNC_BUSY) break;
 			
-			if (pn532_packetbuffer[0] == 0 &&
-				pn532_packetbuffer[1] == 0 &&
-				pn532_packetbuffer[2] == 0xff &&
-				pn532_packetbuffer[4] == (uint8_t)(~pn532_packetbuffer[3] + 1) &&
-				pn532_packetbuffer[5] == PN532_PN532TOHOST &&
-				pn532_packetbuffer[6] == PN532_RESPONSE_INDATAEXCHANGE &&
-				pn532_packetbuffer[7] == 0) {
-					
-				memcpy(ezlink, pn532_packetbuffer + 16, 8);
-				*balance = (float)(pn532_packetbuffer[11] * 256 + pn532_packetbuffer[12]) / 100;
-				
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.print("PN532_I2C::checkForEZLink: EZLink CAN:");
-					for (int i = 0; i < 8; i ++) {
-						Serial.print(" "); Serial.print(print8bitHex(ezlink[i]));
-					}
-					Serial.print(" with balance of ");
-					Serial.println(*balance);
+			if (result == PN532_ASYNC_DONE && decodeEZLink(purse)) {
+				#ifdef PN532_I2C_EVENTS
+					postCardEvents(purse);
 				#endif
-				checkForEZLink_state = 6;
-//				return true;
+				_ezlink_retries = PN532_EZLINK_RETRIES;
+				_ezlink_state = 4;
+			} else if (_ezlink_retries > 0) {
+				// The card is still listed, only read again
+				_ezlink_retries--;
+				_ezlink_state = 2;
 			} else {
-				checkForEZLink_state = 0;
+				// Release the card all the same, then report the failure
+				_ezlink_error = _last_error;
+				_ezlink_retries = PN532_EZLINK_RETRIES;
+				_ezlink_state = 4;
 			}
 			break;
-		case 6:
-			pn532_packetbuffer[0] = PN532_COMMAND_INRELEASE;
-			pn532_packetbuffer[1] = 1;
-			
+		case 4:
 			#ifdef PN532_EZLINK_DEBUG 
-				Serial.println("PN532_I2C::checkForEZLink: Request release of EZLink Card");
+				Serial.println(F("PN532_I2C::checkForEZLink: Request release of EZLink Card"));
 			#endif
 			
-			if (!sendCommandCheckAck(pn532_packetbuffer, 8, 100)) {
-				#ifdef PN532_EZLINK_DEBUG
-					Serial.println("PN532_I2C::checkForEZLink: ERROR - NP532 is not responding");
-				#endif
+			if (submitFrame(pn532frame_release_ezlink, sizeof(pn532frame_release_ezlink))) {
+				_ezlink_state = 5;
 			} else {
-				checkForEZLink_state = 7;
+				_ezlink_state = 0;
 			}
 			break;
-		case 7:
-			// Wait for card to reply to the read request
-			if ( wirereadstatus() == PN532_I2C_READY ) {
-				checkForEZLink_state = 8;
+		case 5:
+			result = poll();
+			if (result == PN532_ASYNC_BUSY) break;
+			
+			if (result == PN532_ASYNC_DONE &&
+				_frame.getResponseCode() == PN532_RESPONSE_INRELEASE &&
+				checkCardStatus() == PN532_OK) {
+				_ezlink_state = 0;
+				if (_ezlink_error == PN532_OK) return true;
+				
+				// The read had failed
+				_last_error = _ezlink_error;
+				#ifdef PN532_I2C_EVENTS
+					postEvent(PN532_EVENT_ERROR, _last_error, micros(), 0, 0);
+				#endif
+				break;
 			}
-			break;
-		case 8:
-			wirereaddata(pn532_packetbuffer, sizeof(pn532_packetbuffer));
 			
-			checkForEZLink_state = 0;
-
-			if (pn532_packetbuffer[0] == 0 &&
-				pn532_packetbuffer[1] == 0 &&
-				pn532_packetbuffer[2] == 0xff &&
-				pn532_packetbuffer[4] == (uint8_t)(~pn532_packetbuffer[3] + 1) &&
-				pn532_packetbuffer[5] == PN532_PN532TOHOST &&
-				pn532_packetbuffer[6] == PN532_RESPONSE_INRELEASE &&
-				pn532_packetbuffer[7] == 0) {
-				return true;
+			if (_ezlink_retries > 0) {
+				_ezlink_retries--;
+				_ezlink_state = 4;
+			} else {
+				// A failed read is the error worth reporting
+				if (_ezlink_error != PN532_OK) _last_error = _ezlink_error;
+				#ifdef PN532_I2C_EVENTS
+					postEvent(PN532_EVENT_ERROR, _last_error, micros(), 0, 0);
+				#endif
+				_ezlink_state = 0;
 			}
 			break;
 		default:
-			checkForEZLink_state = 0;
+			_ezlink_state = 0;
 			break;
 	}
 	
 	return false;
 }
+
+/**************************************************************************/
+/*! 
+    @brief  Former checkForEZLink_Transparent(), deprecated: use the
+            PN532_Purse one
+
+    @param  ezlink    Receives the CAN, 8 bytes, once the card was read
+    @param  balance   Receives the balance in dollars, likewise
+*/
+/**************************************************************************/
+bool PN532_I2C::checkForEZLink_Transparent(uint8_t * ezlink, float * balance) {
+	PN532_Purse purse;
+	uint8_t state = _ezlink_state;
+	bool done = checkForEZLink_Transparent(&purse);
+	
+	// The purse is decoded by the step from the read to the release
+	if (state == 3 && _ezlink_state == 4) {
+		memcpy(ezlink, purse.can, 8);
+		*balance = purse.balance / 100.0;
+	}
+	return done;
+}
+
+
+#ifdef PN532_I2C_EVENTS
+
+/**************************************************************************/
+/*! 
+    @brief  Queues an event, from the API call that saw it happen (not
+            from the IRQ handler). The event is dropped if the queue is
+            full.
+*/
+/**************************************************************************/
+void PN532_I2C::postEvent(uint8_t type, PN532_Status status, uint32_t when, const uint8_t * can, int32_t balance) {
+	uint8_t head = _event_head;
+	PN532_Event * event;
+	
+	if ((uint8_t)(head - _event_tail) >= PN532_EVENT_QUEUE_SIZE) return;
+	
+	event = &_events[head & (PN532_EVENT_QUEUE_SIZE - 1)];
+	event->type = type;
+	event->status = status;
+	event->micros = when;
+	if (can) memcpy(event->can, can, 8);
+	else memset(event->can, 0, 8);
+	event->balance = balance;
+	
+	_event_head = head + 1;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Queues the events of a card just read: arrival (and removal
+            of the previous card) if it is not the card already present,
+            then the read itself. A card resting on the reader only
+            refreshes its presence.
+*/
+/**************************************************************************/
+void PN532_I2C::postCardEvents(PN532_Purse * purse) {
+	if (_presence_valid && memcmp(_presence_can, purse->can, 8) == 0) {
+		_presence_seen = millis();
+		return;
+	}
+	
+	if (_presence_valid) {
+		postEvent(PN532_EVENT_CARD_REMOVED, PN532_OK, _event_detected, _presence_can, 0);
+	}
+	postArrivalEvents(purse, _event_detected);
+	
+	memcpy(_presence_can, purse->can, 8);
+	_presence_valid = true;
+	_presence_seen = millis();
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Queues the arrival of a card and its read
+
+    @param  purse     The purse just read
+    @param  detected  micros() when the card was detected
+*/
+/**************************************************************************/
+void PN532_I2C::postArrivalEvents(PN532_Purse * purse, uint32_t detected) {
+	postEvent(PN532_EVENT_CARD_ARRIVED, PN532_OK, detected, purse->can, 0);
+	postEvent(PN532_EVENT_READ_COMPLETE, PN532_OK, micros(), purse->can, purse->balance);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Queues the removal of the present card once it has not been
+            seen for the hold time (setPresenceHold())
+*/
+/**************************************************************************/
+void PN532_I2C::checkCardRemoved(void) {
+	if (_presence_valid && millis() - _presence_seen > _presence_hold) {
+		_presence_valid = false;
+		postEvent(PN532_EVENT_CARD_REMOVED, PN532_OK, micros(), _presence_can, 0);
+	}
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Takes the oldest queued event, for callers handling events
+            without callbacks
+
+    @returns  false if the queue is empty
+*/
+/**************************************************************************/
+bool PN532_I2C::getEvent(PN532_Event * event) {
+	uint8_t tail = _event_tail;
+	
+	if (tail == _event_head) return false;
+	
+	memcpy(event, &_events[tail & (PN532_EVENT_QUEUE_SIZE - 1)], sizeof(PN532_Event));
+	_event_tail = tail + 1;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Calls the callback of every queued event, oldest first. To be
+            called from loop().
+
+    @returns  The number of events taken from the queue
+*/
+/**************************************************************************/
+uint8_t PN532_I2C::dispatchEvents(void) {
+	PN532_Event event;
+	uint8_t count = 0;
+	
+	while (getEvent(&event)) {
+		if (_event_callbacks[event.type]) _event_callbacks[event.type](this, &event);
+		count++;
+	}
+	return count;
+}
+
+#endif
+
+#ifdef PN532_I2C_STATS
+
+// Upper bounds (us) of the histogram buckets, the last one is unbounded
+static const uint32_t pn532_stats_buckets[PN532_STATS_BUCKETS - 1] PROGMEM = {
+	500, 1000, 2000, 5000, 10000, 50000, 200000
+};
+
+/**************************************************************************/
+/*! 
+    @brief  Records the duration of a phase of the command in progress,
+            and starts timing the next phase
+
+    @param  phase     PN532_STATS_ACK, PN532_STATS_RESPONSE or PN532_STATS_READ
+*/
+/**************************************************************************/
+void PN532_I2C::recordStats(uint8_t phase) {
+	uint32_t now = micros();
+	uint32_t elapsed = now - _stats_start;
+	PN532_CommandStats * cmd = 0;
+	PN532_PhaseStats * stats;
+	uint8_t i;
+	
+	_stats_start = now;
+	
+	for (i=0; i<PN532_STATS_COMMANDS; i++) {
+		if (_stats.commands[i].command == _stats_command) {
+			cmd = &_stats.commands[i];
+			break;
+		}
+		if (_stats.commands[i].command == 0xFF) {
+			cmd = &_stats.commands[i];
+			cmd->command = _stats_command;
+			break;
+		}
+	}
+	// Table full, this command is not tracked
+	if (cmd == 0) return;
+	
+	stats = &cmd->phase[phase];
+	if (stats->count == 0 || elapsed < stats->min) stats->min = elapsed;
+	if (elapsed > stats->max) stats->max = elapsed;
+	stats->total += elapsed;
+	if (stats->count < 0xFFFF) stats->count++;
+	
+	for (i=0; i<PN532_STATS_BUCKETS - 1; i++) {
+		if (elapsed < pgm_read_dword(&pn532_stats_buckets[i])) break;
+	}
+	if (stats->histogram[i] < 0xFFFF) stats->histogram[i]++;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Counts a failed command by kind of failure
+*/
+/**************************************************************************/
+void PN532_I2C::recordError(PN532_Status status) {
+	switch (status) {
+		case PN532_ERROR_TIMEOUT:
+			_stats.timeouts++;
+			break;
+		case PN532_ERROR_NACK:
+			_stats.noacks++;
+			break;
+		case PN532_ERROR_PREAMBLE:
+		case PN532_ERROR_LCS:
+		case PN532_ERROR_DCS:
+		case PN532_ERROR_TFI:
+		case PN532_ERROR_OVERFLOW:
+			_stats.checksum_errors++;
+			break;
+		case PN532_ERROR_CARD:
+			_stats.card_errors++;
+			break;
+		case PN532_ERROR_RESPONSE:
+			_stats.response_errors++;
+			break;
+		default:
+			break;
+	}
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Copies the statistics gathered since the last resetStats()
+
+    @param  snapshot  Receives the statistics
+*/
+/**************************************************************************/
+void PN532_I2C::getStats(PN532_Stats * snapshot) {
+	memcpy(snapshot, &_stats, sizeof(_stats));
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Clears all statistics
+*/
+/**************************************************************************/
+void PN532_I2C::resetStats(void) {
+	memset(&_stats, 0, sizeof(_stats));
+	for (uint8_t i=0; i<PN532_STATS_COMMANDS; i++) {
+		_stats.commands[i].command = 0xFF;
+	}
+}
+
+#endif
+
+
+#ifdef PN532_I2C_TRACE
+
+/**************************************************************************/
+/*! 
+    @brief  Keeps a copy of one I2C transfer in the trace ring buffer.
+            Only copies bytes, formatting is left to dumpTrace()
+
+    @param  dir       PN532_TRACE_TX or PN532_TRACE_RX
+    @param  buff      Bytes transferred (status byte excluded)
+    @param  n         Number of bytes transferred
+*/
+/**************************************************************************/
+void PN532_I2C::recordTrace(uint8_t dir, const uint8_t* buff, uint8_t n) {
+	PN532_TraceEntry * entry = &_trace[_trace_next];
+	
+	entry->micros = micros();
+	entry->dir = dir;
+	entry->len = n;
+	memcpy(entry->data, buff, (n < PN532_TRACE_DATALEN) ? n : PN532_TRACE_DATALEN);
+	
+	_trace_next = (_trace_next + 1) % PN532_TRACE_ENTRIES;
+	if (_trace_count < PN532_TRACE_ENTRIES) _trace_count++;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Prints the recorded transfers, oldest first, one per line:
+            <micros> TX|RX <len>: <bytes>
+            Bytes beyond PN532_TRACE_DATALEN are shown as "..."
+
+    @param  out       Where to print, e.g. Serial
+*/
+/**************************************************************************/
+void PN532_I2C::dumpTrace(Print & out) {
+	uint8_t index = (_trace_next + PN532_TRACE_ENTRIES - _trace_count) % PN532_TRACE_ENTRIES;
+	
+	for (uint8_t i=0; i<_trace_count; i++) {
+		PN532_TraceEntry * entry = &_trace[index];
+		uint8_t kept = (entry->len < PN532_TRACE_DATALEN) ? entry->len : PN532_TRACE_DATALEN;
+		
+		out.print(entry->micros);
+		if (entry->dir == PN532_TRACE_TX) out.print(F(" TX "));
+		else out.print(F(" RX "));
+		out.print(entry->len);
+		out.print(F(":"));
+		for (uint8_t j=0; j<kept; j++) {
+			out.print(F(" ")); print8bitHex(out, entry->data[j]);
+		}
+		if (kept < entry->len) out.print(F(" ..."));
+		out.println();
+		
+		index = (index + 1) % PN532_TRACE_ENTRIES;
+	}
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Forgets all recorded transfers
+*/
+/**************************************************************************/
+void PN532_I2C::clearTrace(void) {
+	_trace_next = 0;
+	_trace_count = 0;
+}
+
+#endif
+
+
+#ifdef PN532_I2C_SCHEDULER
+
+/**************************************************************************/
+/*! 
+    @brief  Creates an empty scheduler
+*/
+/**************************************************************************/
+PN532_I2C_Scheduler::PN532_I2C_Scheduler(void) {
+	_count = 0;
+	_next = 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Adds a reader to the scheduler
+
+    @returns  false if PN532_SCHEDULER_MAX_READERS readers are already
+              added, or if the reader uses the PN532_MINIMAL shared buffer
+*/
+/**************************************************************************/
+bool PN532_I2C_Scheduler::add(PN532_I2C * reader) {
+	if (_count >= PN532_SCHEDULER_MAX_READERS) return false;
+	#ifdef PN532_MINIMAL
+		if (reader->hasSharedBuffer()) return false;
+	#endif
+	
+	_readers[_count++] = reader;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Makes one step (one poll()) on the next reader, in round robin
+            order, that has a command in progress. Results are delivered
+            through the callbacks given to submit().
+
+    @returns  The reader that was served, 0 if no reader is busy
+*/
+/**************************************************************************/
+PN532_I2C * PN532_I2C_Scheduler::run(void) {
+	PN532_I2C * reader;
+	
+	for (uint8_t i=0; i<_count; i++) {
+		reader = _readers[_next];
+		_next = (_next + 1) % _count;
+		
+		if (reader->isBusy()) {
+			reader->poll();
+			return reader;
+		}
+	}
+	return 0;
+}
+
+#endif
@@ -16,11 +16,22 @@
 
 #if defined(ARDUINO) && ARDUINO >= 100
 	#include "Arduino.h"
+#elif !defined(ARDUINO) && defined(__linux__)
+	#include "PN532_Linux.h"
 #else
 	#include "WProgram.h"
 #endif
 
-#include <Wire.h>
+#include "PN532_Transport.h"
+
+// Smallest RAM profile, for an EZLink reader on a 2 KB MCU (ATmega328)
+// next to other libraries: the tables sized below keep a single entry,
+// the timeout table holds the EZLink commands only, and readers share one
+// receive buffer unless given their own (see the constructor). Each size
+// can also be set on its own with -D in the build flags, for the library
+// and the sketch alike. Unused functions cost no flash either way, the
+// linker drops them.
+//#define PN532_MINIMAL
 
 // PN532 I2C Shield uses the following pins
 // Analog 4 => I2C
@@ -30,16 +41,87 @@
 
 
 // PN532 Commands
+#define PN532_COMMAND_DIAGNOSE              (0x00)
 #define PN532_COMMAND_GETFIRMWAREVERSION    (0x02)
 #define PN532_COMMAND_SAMCONFIGURATION      (0x14)
+#define PN532_COMMAND_POWERDOWN             (0x16)
+#define PN532_COMMAND_RFCONFIGURATION       (0x32)
 #define PN532_COMMAND_INLISTPASSIVETARGET   (0x4A)
 #define PN532_COMMAND_INDATAEXCHANGE        (0x40)
 #define PN532_COMMAND_INRELEASE             (0x52)
+#define PN532_COMMAND_INAUTOPOLL            (0x60)
 
 // PN532 Responses
+#define PN532_RESPONSE_DIAGNOSE             (0x01)
+#define PN532_RESPONSE_POWERDOWN            (0x17)
+#define PN532_RESPONSE_RFCONFIGURATION      (0x33)
 #define PN532_RESPONSE_INLISTPASSIVETARGET  (0x4B)
 #define PN532_RESPONSE_INDATAEXCHANGE       (0x41)
 #define PN532_RESPONSE_INRELEASE            (0x53)
+#define PN532_RESPONSE_INAUTOPOLL           (0x61)
+
+// RFConfiguration items
+#define PN532_RFCFG_FIELD                   (0x01)
+#define PN532_RFCFG_TIMINGS                 (0x02)
+#define PN532_RFCFG_MAXRTYCOM               (0x04)
+#define PN532_RFCFG_MAXRETRIES              (0x05)
+
+// RFConfiguration presets, for applyRFPreset()
+#define PN532_RF_PRESET_DEFAULT             (0) // Chip defaults: retry activation forever
+#define PN532_RF_PRESET_FAST_POLL           (1) // One activation attempt, short timeouts
+#define PN532_RF_PRESET_ROBUST_READ         (2) // Few activation attempts, long timeouts, retries
+
+// Target types (InAutoPoll). Types 0x00 to 0x04 are also the BrTy
+// values of InListPassiveTarget.
+#define PN532_TARGET_GENERIC_106A           (0x00)
+#define PN532_TARGET_FELICA_212             (0x01)
+#define PN532_TARGET_FELICA_424             (0x02)
+#define PN532_TARGET_GENERIC_106B           (0x03)
+#define PN532_TARGET_JEWEL                  (0x04)
+#define PN532_TARGET_MIFARE                 (0x10)
+#define PN532_TARGET_ISO14443_4A            (0x20)
+#define PN532_TARGET_ISO14443_4B            (0x23)
+
+// FeliCa POLLING payload sent with InListPassiveTarget at 212/424 kbps
+#define PN532_FELICA_POLLING_LENGTH         (5)
+
+// Longest target identifier kept in PN532_Target
+#define PN532_TARGET_ID_LENGTH              (12)
+
+// CEPAS purse (EZLink) as returned by the read purse APDU, data offsets
+#define PN532_PURSE_LENGTH                  (62) // Up to the last transaction record
+
+// Receive buffer an EZLink purse read needs: the answer holds the
+// response code, the status byte, the 95 byte purse and SW1 SW2
+#define PN532_EZLINK_BUFSIZ                 (PN532_FRAME_SIZE(99))
+#define PN532_PURSE_STATUS_ENABLED          (0x01)
+
+// CEPAS transaction history: records kept by the card, and records read
+// per InDataExchange (16 bytes each, the answer must fit the receive buffer)
+#define PN532_HISTORY_MAX                   (30)
+#define PN532_HISTORY_BATCH(buffsiz)        (((buffsiz) - 12) / 16)
+#define PN532_HISTORY_BUFSIZ                (12 + 16) // Receive buffer for one record
+
+// Most targets the PN532 can list at once
+#ifndef PN532_MAX_TARGETS
+	#ifdef PN532_MINIMAL
+		#define PN532_MAX_TARGETS           (1)
+	#else
+		#define PN532_MAX_TARGETS           (2)
+	#endif
+#endif
+
+// Most card handlers registered with addCardHandler()
+#ifndef PN532_MAX_HANDLERS
+	#ifdef PN532_MINIMAL
+		#define PN532_MAX_HANDLERS          (1)
+	#else
+		#define PN532_MAX_HANDLERS          (4)
+	#endif
+#endif
+
+// Longest data sent with dataExchange() in a single frame
+#define PN532_DATAEXCHANGE_MAXLEN           (PN532_I2C_WIRE_BUFSIZ - PN532_FRAME_SIZE(2))
 
 #define PN532_PREAMBLE                      (0x00)
 #define PN532_STARTCODE1                    (0x00)
@@ -49,30 +131,547 @@
 #define PN532_HOSTTOPN532                   (0xD4)
 #define PN532_PN532TOHOST                   (0xD5)
 
-#define PN532_I2C_ADDRESS                   (0x48 >> 1)
-#define PN532_I2C_BUSY                      (0x00)
-#define PN532_I2C_READY                     (0x01)
+// Receive buffer of each reader, large enough for a full EZLink purse
+// response (LEN = 100). Readers of cards with shorter answers only can
+// make it smaller; a longer response then fails with PN532_ERROR_OVERFLOW.
+// With PN532_MINIMAL the readers built without a buffer of their own share
+// a single one.
+#ifndef PN532_PACKBUFFSIZ
+	#define PN532_PACKBUFFSIZ               (112)
+#endif
+#if PN532_PACKBUFFSIZ < PN532_I2C_WIRE_BUFSIZ
+	#error "PN532_PACKBUFFSIZ must hold at least one bus transfer"
+#endif
+
+// Per command latency and error statistics, see getStats(). Uncomment to
+// compile them in (about 90 bytes of RAM per command code tracked).
+//#define PN532_I2C_STATS
+
+#define PN532_STATS_COMMANDS                (6) // Command codes tracked
+#define PN532_STATS_BUCKETS                 (8) // <0.5, <1, <2, <5, <10, <50, <200, >=200 ms
+#define PN532_STATS_ACK                     (0) // Command sent to ACK ready
+#define PN532_STATS_RESPONSE                (1) // ACK read to response ready
+#define PN532_STATS_READ                    (2) // Reading the response frame
+#define PN532_STATS_PHASES                  (3)
+
+// Records the raw I2C traffic in RAM, see dumpTrace()
+//#define PN532_I2C_TRACE
+
+#define PN532_TRACE_ENTRIES                 (16) // Transfers kept, oldest overwritten
+#define PN532_TRACE_DATALEN                 (16) // Bytes kept per transfer
+#define PN532_TRACE_TX                      (0)
+#define PN532_TRACE_RX                      (1)
+
+// Card events queued by checkForEZLink_Transparent(), watchEZLink() and
+// pollLowPower(), see dispatchEvents()
+//#define PN532_I2C_EVENTS
+
+#define PN532_EVENT_QUEUE_SIZE              (4) // Power of two
+#define PN532_EVENT_CARD_ARRIVED            (0)
+#define PN532_EVENT_CARD_REMOVED            (1)
+#define PN532_EVENT_READ_COMPLETE           (2)
+#define PN532_EVENT_ERROR                   (3)
+#define PN532_EVENT_TYPES                   (4)
+
+// Readers driven by one PN532_I2C_Scheduler
+#ifndef PN532_SCHEDULER_MAX_READERS
+	#define PN532_SCHEDULER_MAX_READERS     (4)
+#endif
+
+// PN532_I2C_Scheduler, see below. Uncomment to compile it in.
+//#define PN532_I2C_SCHEDULER
+
+// With PN532_MINIMAL the readers share one receive buffer, so only one of
+// them may have a command in flight. Define PN532_SCHEDULER_OWN_BUFFERS
+// when every scheduled reader is given a buffer of its own; add() still
+// refuses the others.
+#if defined(PN532_I2C_SCHEDULER) && defined(PN532_MINIMAL) && !defined(PN532_SCHEDULER_OWN_BUFFERS)
+	#error "PN532_I2C_SCHEDULER with PN532_MINIMAL needs PN532_SCHEDULER_OWN_BUFFERS and a buffer per scheduled reader"
+#endif
+
+// Compile time frame construction. A host to PN532 frame holding a command
+// of len bytes (command code included) whose bytes add up to sum is:
+//   PN532_FRAME_START(len), <command bytes>, PN532_FRAME_END(sum)
+// and is PN532_FRAME_SIZE(len) bytes long, checksums included.
+#define PN532_FRAME_SIZE(len)               ((len) + 8)
+#define PN532_FRAME_START(len)              PN532_PREAMBLE, PN532_STARTCODE1, PN532_STARTCODE2, \
+                                            (uint8_t)((len) + 1), (uint8_t)(0x100 - ((len) + 1)), \
+                                            PN532_HOSTTOPN532
+#define PN532_FRAME_END(sum)                (uint8_t)(0x100 - ((PN532_HOSTTOPN532 + (sum)) & 0xFF)), \
+                                            PN532_POSTAMBLE
+
+
+// Extra attempts of a failed EZLink read or release stage
+#define PN532_EZLINK_RETRIES                (2)
+
+// Diagnose test checking that the listed target is still in the field
+#define PN532_DIAGNOSE_PRESENCE             (0x06)
+
+// Events of watchEZLink()
+#define PN532_CARD_NONE                     (0) // No card, or the same card still there
+#define PN532_CARD_NEW                      (1) // A new card was read
+#define PN532_CARD_GONE                     (2) // The card left for longer than the hold time
+
+// Default time (ms) a departed card is remembered by watchEZLink(), so
+// that a card briefly lifted off the reader is not read as a new card
+#define PN532_PRESENCE_HOLD                 (500)
+
+// Warm start of init(): a PN532 that answers within PN532_WARM_PROBE_TIMEOUT
+// (ms) is not reset. Otherwise it gets a PN532_RESET_PULSE (ms) reset pulse
+// and is polled every PN532_RESET_POLL ms until it answers, for
+// PN532_RESET_TIMEOUT ms at most.
+#define PN532_WARM_PROBE_TIMEOUT            (20)
+#define PN532_RESET_PULSE                   (1)
+#define PN532_RESET_POLL                    (10)
+#define PN532_RESET_TIMEOUT                 (1000)
+
+// PowerDown wake up sources, for powerDown(). The RF level detector wakes
+// the PN532 on an external RF field (a phone, another reader), not on a
+// passive card.
+#define PN532_WAKEUP_I2C                    (0x80)
+#define PN532_WAKEUP_GPIO                   (0x40)
+#define PN532_WAKEUP_SPI                    (0x20)
+#define PN532_WAKEUP_HSU                    (0x10)
+#define PN532_WAKEUP_RF                     (0x08)
+#define PN532_WAKEUP_INT1                   (0x02)
+#define PN532_WAKEUP_INT0                   (0x01)
+
+// Time (ms) the PN532 needs after being woken up before it takes a frame
+#define PN532_WAKE_DELAY                    (2)
+
+// Default intervals (ms) between the polls of pollLowPower(): fast while
+// a card is around, growing to slow when the reader stays idle
+#define PN532_POWER_FAST_INTERVAL           (100)
+#define PN532_POWER_SLOW_INTERVAL           (1000)
+
+// Adaptive command timeouts. Passed as a timeout, PN532_TIMEOUT_ADAPTIVE
+// uses the deadline learned for the command code: smoothed latency plus
+// 4 mean deviations (as TCP retransmission timers), kept between a floor
+// and a ceiling (setTimeoutBounds()). A command not timed yet gets its
+// ceiling; a command that times out doubles its next deadline. Only the
+// commands waited for with PN532_TIMEOUT_ADAPTIVE take a slot.
+#define PN532_TIMEOUT_ADAPTIVE              (0xFFFF)
+#ifndef PN532_TIMEOUT_COMMANDS
+	#ifdef PN532_MINIMAL
+		#define PN532_TIMEOUT_COMMANDS      (4) // Command codes learned
+	#else
+		#define PN532_TIMEOUT_COMMANDS      (8)
+	#endif
+#endif
+#define PN532_TIMEOUT_FLOOR                 (10) // Default floor, ms
+#define PN532_TIMEOUT_CEILING               (1000) // Default ceiling, ms
+#define PN532_TIMEOUT_CEILING_SEARCH        (2000) // Default ceiling of InListPassiveTarget, ms
+
+// Asynchronous command engine, results of poll()
+#define PN532_ASYNC_IDLE                    (0)
+#define PN532_ASYNC_BUSY                    (1)
+#define PN532_ASYNC_DONE                    (2)
+#define PN532_ASYNC_ERROR                   (3)
+
+// IRQ pin argument of a PN532 whose IRQ line is not wired. Readiness is
+// then read from the status byte leading each read, retried at growing
+// intervals (microseconds) while the PN532 is busy.
+#define PN532_NO_IRQ                        (0xFF)
+#define PN532_POLL_MIN_US                   (250)
+#define PN532_POLL_MAX_US                   (4000)
+
+// Marks the calls kept for sketches written against older releases
+#ifdef __GNUC__
+	#define PN532_DEPRECATED                __attribute__((deprecated))
+#else
+	#define PN532_DEPRECATED
+#endif
+
+// Number of PN532_I2C instances that can use IRQ interrupts
+#define PN532_I2C_MAX_IRQ_INSTANCES         (2)
+
+// Time allowed for the PN532 to resend a frame after a NACK (ms)
+#define PN532_I2C_RESEND_TIMEOUT            (10)
+
+
+// Result of a PN532 command
+enum PN532_Status {
+	PN532_OK = 0,
+	PN532_ERROR_TIMEOUT,    // PN532 did not answer in time
+	PN532_ERROR_NACK,       // No ACK frame after the command
+	PN532_ERROR_PREAMBLE,   // Preamble or start code missing
+	PN532_ERROR_LCS,        // Bad length checksum
+	PN532_ERROR_DCS,        // Bad data checksum
+	PN532_ERROR_TFI,        // Frame is not from the PN532 to the host
+	PN532_ERROR_OVERFLOW,   // Frame larger than the receive buffer
+	PN532_ERROR_RESPONSE,   // Unexpected response code
+	PN532_ERROR_CARD,       // Status byte reports a card side error
+	PN532_ERROR_TARGET,     // Not exactly one target found
+	PN532_ERROR_SHARED      // Shared buffer (PN532_MINIMAL) taken by another reader
+};
+
+// Validated view over a response frame held in a receive buffer.
+// Nothing is copied: the payload points into the buffer.
+class PN532_FrameView {
+	public:
+					PN532_FrameView(void) : _data(0), _len(0) {}
+		PN532_Status	parse(uint8_t * frame, uint8_t framelen, uint8_t response = 0);
+		PN532_Status	checkStatus(void);
+		
+		uint8_t		getResponseCode(void) { return _data[1]; }
+		uint8_t		getStatus(void) { return _data[2]; }
+		uint8_t *	getPayload(void) { return _data + 2; }
+		uint8_t		getPayloadLength(void) { return _len - 2; }
+		
+	private:
+		uint8_t *	_data; // TFI, response code, payload
+		uint8_t		_len; // LEN field of the frame
+};
+
+// A target (card) found by InAutoPoll or InListPassiveTarget
+struct PN532_Target {
+	uint8_t		tg; // Logical target number, for InDataExchange
+	uint8_t		type; // PN532_TARGET_*
+	uint8_t		sak; // SEL_RES of type A targets, 0 otherwise
+	uint8_t		idlen;
+	uint8_t		id[PN532_TARGET_ID_LENGTH]; // Type A: UID, type B: ATQB, FeliCa: IDm
+};
+
+// CEPAS transaction record
+struct PN532_PurseTransaction {
+	uint8_t		type;
+	int32_t		amount; // Cents, negative for a debit
+	uint32_t	datetime; // Seconds since 1995-01-01 00:00 (Singapore time)
+	uint8_t		user[8]; // User data, e.g. the station or bus service
+};
+
+// CEPAS purse, decoded without floating point
+struct PN532_Purse {
+	uint8_t		version; // CEPAS version
+	uint8_t		status; // PN532_PURSE_STATUS_ENABLED bit set if usable
+	int32_t		balance; // Cents, may be negative
+	int32_t		autoload; // Auto-load amount, cents
+	uint8_t		can[8]; // Card Application Number, printed on the card
+	uint8_t		csn[8]; // Card Serial Number
+	uint16_t	expiry; // Days since 1995-01-01
+	uint16_t	created; // Days since 1995-01-01
+	PN532_PurseTransaction	last; // Last transaction
+};
+
+// Latency estimate of one command code, see PN532_TIMEOUT_ADAPTIVE
+struct PN532_CommandTimeout {
+	uint8_t		command; // Command code, 0xFF if the slot is unused
+	uint16_t	srtt; // Smoothed latency, 1/8 ms, 0 until timed
+	uint16_t	rttvar; // Mean deviation of the latency, 1/8 ms
+	uint16_t	floor; // ms
+	uint16_t	ceiling; // ms
+};
+
+// Durations of one phase of a command, in microseconds
+struct PN532_PhaseStats {
+	uint16_t	count;
+	uint32_t	min;
+	uint32_t	max;
+	uint32_t	total; // Mean is total / count. Wraps after 71 minutes.
+	uint16_t	histogram[PN532_STATS_BUCKETS];
+};
+
+struct PN532_CommandStats {
+	uint8_t				command; // Command code, 0xFF if the slot is unused
+	PN532_PhaseStats	phase[PN532_STATS_PHASES];
+};
+
+struct PN532_Stats {
+	PN532_CommandStats	commands[PN532_STATS_COMMANDS];
+	uint16_t	timeouts;
+	uint16_t	noacks;
+	uint16_t	checksum_errors; // Bad preamble, LCS, DCS, TFI or length
+	uint16_t	card_errors; // Error status reported by the PN532 / card
+	uint16_t	response_errors; // Unexpected response code
+};
+
+// One I2C transfer, as recorded by PN532_I2C_TRACE
+struct PN532_TraceEntry {
+	uint32_t	micros;
+	uint8_t		dir; // PN532_TRACE_TX or PN532_TRACE_RX
+	uint8_t		len; // Bytes transferred, only PN532_TRACE_DATALEN are kept
+	uint8_t		data[PN532_TRACE_DATALEN];
+};
+
+class PN532_I2C;
+
+// A card event, see PN532_I2C_EVENTS
+struct PN532_Event {
+	uint8_t			type; // PN532_EVENT_*
+	PN532_Status	status; // PN532_EVENT_ERROR: why the read failed
+	uint32_t		micros; // When it happened (card arrival: IRQ edge, if captured)
+	uint8_t			can[8]; // CAN of the card, not set for PN532_EVENT_ERROR
+	int32_t			balance; // PN532_EVENT_READ_COMPLETE: purse balance in cents
+};
+
+typedef void (*PN532_EventCallback)(PN532_I2C * reader, const PN532_Event * event);
+
+// Called by poll() when a submitted command completes. frame points to the
+// full response frame (preamble included), or is 0 if the command failed.
+typedef void (*PN532_I2C_Callback)(PN532_I2C * reader, uint8_t * frame, uint8_t framelen);
+
+// Reads a card found by readCard(). context is the pointer given to
+// addCardHandler(). Returns true if the card was read. Handlers run
+// blocking commands: readCard() returns once they are done.
+typedef bool (*PN532_CardReader)(PN532_I2C * reader, PN532_Target * target, void * context);
 
+// A card protocol readCard() listens for
+struct PN532_CardHandler {
+	uint8_t				type; // PN532_TARGET_*, as polled by InAutoPoll
+	uint8_t				sakmask; // Type A: handles targets with (sak & sakmask) == sak
+	uint8_t				sak;
+	PN532_CardReader	read;
+	void *				context;
+};
+
+#ifdef PN532_MINIMAL
+	extern uint8_t pn532_shared_buffer[PN532_PACKBUFFSIZ];
+#endif
 
 class PN532_I2C {
 	public:
-					PN532_I2C(uint8_t pin_irq, uint8_t pin_reset);
-		bool 		init(void);
-		bool	 	checkForEZLink(uint8_t * ezlink, float * balance);
-		bool	 	checkForEZLink_Transparent(uint8_t * ezlink, float * balance);
+		// Receives into the shared buffer with PN532_MINIMAL (only the
+		// first reader to init() may use it), into its own otherwise
+					PN532_I2C(uint8_t pin_irq, uint8_t pin_reset, uint8_t address = PN532_TRANSPORT_ADDRESS) : _transport(address) {
+			#ifdef PN532_MINIMAL
+				construct(pin_irq, pin_reset, pn532_shared_buffer, PN532_PACKBUFFSIZ);
+			#else
+				construct(pin_irq, pin_reset, _buffer, PN532_PACKBUFFSIZ);
+			#endif
+		}
+		#ifdef PN532_MINIMAL
+					~PN532_I2C(void);
+		#endif
+		// Receives into buffer, of at least PN532_I2C_WIRE_BUFSIZ bytes
+		// (init() fails with PN532_ERROR_OVERFLOW otherwise).
+		// checkForEZLink() needs PN532_EZLINK_BUFSIZ, a history read
+		// PN532_HISTORY_BUFSIZ; shorter answers fail with the same error.
+					PN532_I2C(uint8_t pin_irq, uint8_t pin_reset, uint8_t address, uint8_t * buffer, uint8_t buffersize) : _transport(address) {
+			construct(pin_irq, pin_reset, buffer, buffersize);
+		}
+		#if PN532_TRANSPORT == PN532_TRANSPORT_I2C
+			void	setMux(uint8_t mux_address, uint8_t channel) { _transport.setMux(mux_address, channel); }
+		#endif
+		#if PN532_TRANSPORT == PN532_TRANSPORT_LINUX
+			void	setDevice(const char * path) { _transport.setDevice(path); }
+		#endif
+		bool 		init(uint32_t busclock = PN532_TRANSPORT_CLOCK, bool warm = true);
+		bool		isWarmStart(void) { return _warm_start; }
+		bool	 	checkForEZLink(PN532_Purse * purse, PN532_PurseTransaction * history = 0,
+						uint8_t count = 0, uint8_t * found = 0);
+		bool	 	checkForEZLink_Transparent(PN532_Purse * purse);
+		// Former calls: CAN (8 bytes) and balance in dollars only
+		bool		checkForEZLink(uint8_t * ezlink, float * balance) PN532_DEPRECATED;
+		bool		checkForEZLink_Transparent(uint8_t * ezlink, float * balance) PN532_DEPRECATED;
+		
+		bool		submit(uint8_t *cmd, uint8_t cmdlen, PN532_I2C_Callback callback = 0, uint16_t timeout = PN532_TIMEOUT_ADAPTIVE);
+		bool		submitFrame(const uint8_t *frame, uint8_t framelen, PN532_I2C_Callback callback = 0, uint16_t timeout = PN532_TIMEOUT_ADAPTIVE);
+		uint8_t		poll(void);
+		void		abort(void);
+		bool		isBusy(void) { return _async_state != PN532_ASYNC_IDLE; }
+		#ifdef PN532_MINIMAL
+			bool	hasSharedBuffer(void) { return _packetbuffer == pn532_shared_buffer; }
+		#endif
+		uint8_t *	getResponse(void);
+		PN532_FrameView *	getFrame(void) { return &_frame; }
+		PN532_Status	getLastError(void) { return _last_error; }
+		uint8_t		getResponseLength(void) { return _async_framelen; }
+		
+		bool		setRFField(bool on, bool autorfca = false);
+		bool		setRFTimings(uint8_t atr_res_timeout, uint8_t retry_timeout);
+		bool		setMaxRetries(uint8_t atr, uint8_t psl, uint8_t passive_activation);
+		bool		setMaxRetryCOM(uint8_t retries);
+		bool		applyRFPreset(uint8_t preset);
+		
+		void		setTimeoutBounds(uint16_t floor, uint16_t ceiling);
+		void		setTimeoutBounds(uint8_t command, uint16_t floor, uint16_t ceiling);
+		uint16_t	getTimeout(uint8_t command);
+		void		resetTimeouts(void);
+		
+		uint8_t		listTargets(uint8_t brty, PN532_Target *targets, uint8_t maxtargets, uint16_t timeout = PN532_TIMEOUT_ADAPTIVE);
+		PN532_Status	dataExchange(uint8_t tg, const uint8_t *data, uint8_t len, uint16_t timeout = PN532_TIMEOUT_ADAPTIVE);
+		bool		releaseTarget(uint8_t tg = 0);
+		bool		readEZLink(uint8_t tg, PN532_Purse * purse);
+		uint8_t		readEZLinkHistory(uint8_t tg, PN532_PurseTransaction * history, uint8_t count);
+		
+		bool		addCardHandler(uint8_t type, PN532_CardReader read, void * context = 0,
+						uint8_t sakmask = 0, uint8_t sak = 0);
+		uint8_t		readCard(uint8_t pollnr = 1, uint8_t period = 1);
+		static bool	readEZLinkCard(PN532_I2C * reader, PN532_Target * target, void * purse);
+		static bool	readCardUID(PN532_I2C * reader, PN532_Target * target, void * copy);
+		
+		uint8_t		watchEZLink(PN532_Purse * purse);
+		bool		isCardPresent(void);
+		void		setPresenceHold(uint16_t hold) { _presence_hold = hold; }
+		
+		bool		powerDown(uint8_t wakeup = PN532_TRANSPORT_WAKEUP);
+		bool		isAsleep(void) { return _asleep; }
+		void		setDutyCycle(uint16_t fast, uint16_t slow);
+		uint8_t		pollLowPower(PN532_Purse * purse);
+		uint16_t	getIdleTime(void);
+		
+		bool		startAutoPoll(const uint8_t *types, uint8_t ntypes, uint8_t pollnr = 0xFF, uint8_t period = 2);
+		uint8_t		pollAutoPoll(PN532_Target *targets, uint8_t maxtargets, uint8_t *found);
+		
+		bool		useIRQInterrupt(bool enable = true);
+		void		handleIRQ(void); // Called from the IRQ interrupt handler
+		uint32_t	getIRQMicros(void) { return _irq_micros; }
+		
+		#ifdef PN532_I2C_STATS
+			void		getStats(PN532_Stats * snapshot);
+			void		resetStats(void);
+		#endif
+		
+		#ifdef PN532_I2C_TRACE
+			void		dumpTrace(Print & out);
+			void		clearTrace(void);
+		#endif
+		
+		#ifdef PN532_I2C_EVENTS
+			void		onCardArrived(PN532_EventCallback callback) { _event_callbacks[PN532_EVENT_CARD_ARRIVED] = callback; }
+			void		onCardRemoved(PN532_EventCallback callback) { _event_callbacks[PN532_EVENT_CARD_REMOVED] = callback; }
+			void		onReadComplete(PN532_EventCallback callback) { _event_callbacks[PN532_EVENT_READ_COMPLETE] = callback; }
+			void		onError(PN532_EventCallback callback) { _event_callbacks[PN532_EVENT_ERROR] = callback; }
+			bool		getEvent(PN532_Event * event);
+			uint8_t		dispatchEvents(void);
+		#endif
+		
+		uint32_t	getBusBytes(void) { return _transport.getBytes(); }
+		void		resetBusBytes(void) { _transport.resetBytes(); }
 		
 	private:
 		uint8_t		_pin_irq, _pin_reset;
+		PN532_TransportType	_transport; // I2C, SPI or HSU, see PN532_TRANSPORT
+		uint8_t *	_packetbuffer; // Receive buffer, _packetsize bytes
+		uint8_t		_packetsize;
+		#ifndef PN532_MINIMAL
+			uint8_t		_buffer[PN532_PACKBUFFSIZ];
+		#endif
 		uint8_t		inListedTag; // Tag number of inlisted tag.
 		
-		uint32_t	getPN532FirmwareVersion(void);
-		bool		sendCommandCheckAck(uint8_t *cmd, uint8_t cmdlen, uint16_t timeout = 1000);
+		bool				_irq_interrupt; // IRQ falling edge is captured by an interrupt
+		volatile bool		_irq_fired;
+		volatile uint32_t	_irq_micros; // micros() of the last IRQ falling edge
+		uint32_t			_poll_next; // No IRQ pin: micros() of the next status read
+		uint16_t			_poll_backoff; // No IRQ pin: interval after a busy read, us
+		
+		uint8_t				_async_state; // Stage of the submitted command
+		uint8_t				_async_framelen;
+		#ifdef PN532_TRANSPORT_STREAM
+			uint8_t			_async_got; // Bytes of the frame read so far
+		#endif
+		uint16_t			_async_timeout;
+		uint32_t			_async_start;
+		PN532_I2C_Callback	_async_callback;
+		
+		PN532_CardHandler	_handlers[PN532_MAX_HANDLERS];
+		uint8_t				_nhandlers;
+		bool				_card_polling; // readCard() waits for its InAutoPoll
+		
+		uint8_t		_presence_can[8]; // CAN of the card watchEZLink() reported
+		bool		_presence_valid; // _presence_can is set
+		bool		_presence_listed; // That card is still listed by the PN532
+		bool		_presence_pending; // Listed card swapped in, its NEW follows the GONE
+		uint16_t	_presence_hold;
+		uint32_t	_presence_seen; // millis() when the card was last seen
+		
+		bool		_asleep; // PowerDown, or just reset: wake before the next frame
+		bool		_warm_start; // init() found the PN532 still powered, not reset
+		uint16_t	_power_fast, _power_slow; // Bounds of the poll interval
+		uint16_t	_power_interval; // Current interval of pollLowPower()
+		uint32_t	_power_last; // millis() of the last poll
+		
+		uint8_t		_ezlink_state; // Stage of checkForEZLink_Transparent
+		uint8_t		_ezlink_retries; // Attempts left for the current stage
+		PN532_Status	_ezlink_error; // Read failure, reported after the release
+		
+		uint8_t		_command; // Code of the last command sent
+		bool		_command_adaptive; // Waited for with PN532_TIMEOUT_ADAPTIVE
+		uint32_t	_command_start; // micros() when it was sent
+		uint16_t	_timeout_floor, _timeout_ceiling; // Bounds of new slots
+		PN532_CommandTimeout	_timeouts[PN532_TIMEOUT_COMMANDS];
+		
+		PN532_FrameView	_frame; // Last response frame
+		PN532_Status	_last_error;
+		
+		#ifdef PN532_I2C_STATS
+			PN532_Stats		_stats;
+			uint8_t			_stats_command; // Command in progress
+			uint32_t		_stats_start; // micros() at the start of the current phase
+			void			recordStats(uint8_t phase);
+			void			recordError(PN532_Status status);
+		#endif
+		
+		#ifdef PN532_I2C_TRACE
+			PN532_TraceEntry	_trace[PN532_TRACE_ENTRIES];
+			uint8_t				_trace_next; // Entry written next
+			uint8_t				_trace_count;
+			void				recordTrace(uint8_t dir, const uint8_t* buff, uint8_t n);
+		#endif
+		
+		#ifdef PN532_I2C_EVENTS
+			// Ring of queued events, filled and emptied from loop()
+			PN532_Event			_events[PN532_EVENT_QUEUE_SIZE];
+			uint8_t				_event_head; // Next slot written by postEvent()
+			uint8_t				_event_tail; // Next slot taken by getEvent()
+			uint32_t			_event_detected; // micros() of the last card detection
+			PN532_EventCallback	_event_callbacks[PN532_EVENT_TYPES];
+			void				postEvent(uint8_t type, PN532_Status status, uint32_t when, const uint8_t * can, int32_t balance);
+			void				postCardEvents(PN532_Purse * purse);
+			void				postArrivalEvents(PN532_Purse * purse, uint32_t detected);
+			void				checkCardRemoved(void);
+		#endif
+		
+		void		construct(uint8_t pin_irq, uint8_t pin_reset, uint8_t * buffer, uint8_t buffersize);
+		uint32_t	getPN532FirmwareVersion(uint16_t timeout);
+		PN532_Status	sendFrameReadResponse(const uint8_t *frame, uint8_t framelen, uint8_t response, uint16_t timeout);
+		PN532_Status	sendCommandReadResponse(uint8_t *cmd, uint8_t cmdlen, uint8_t response, uint16_t timeout);
+		PN532_Status	readResponse(uint8_t response, uint16_t timeout);
+		PN532_CommandTimeout *	findTimeout(uint8_t command, bool create);
+		void		learnTimeout(void);
+		void		backoffTimeout(void);
+		bool		rfConfiguration(uint8_t item, const uint8_t *data, uint8_t len);
+		bool		decodeEZLink(PN532_Purse * purse);
+		PN532_Status	checkCardStatus(void);
 
-		bool		readackframe(void);
 		uint8_t		wirereadstatus(void);
-		void		wirereaddata(uint8_t* buff, uint8_t n);
+		bool		wirereaddata(uint8_t* buff, uint8_t n);
+		#ifdef PN532_TRANSPORT_STREAM
+			uint8_t		wirereadavailable(uint8_t* buff, uint8_t n);
+		#endif
+		uint8_t		wirereadframe(uint8_t* buff, uint8_t maxlen);
+		void		wiresendnack(void);
+		void		wiresendack(void);
 		void		wiresendcommand(uint8_t* cmd, uint8_t cmdlen);
-		bool		waitUntilReady(uint16_t timeout);
+		void		wiresendframe(const uint8_t* frame, uint8_t framelen);
+		void		wakeUp(void);
+		void		wiresendframe_P(const uint8_t* frame, uint8_t framelen);
+		void		wirewrite(const uint8_t* buff, uint8_t n);
+		void		beginWait(bool response);
+		bool		readWhenReady(uint8_t* buff, uint8_t n);
+		bool		waitReadData(uint8_t* buff, uint8_t n, uint16_t timeout);
+		void		clearIRQ(void);
+		void		beginAsync(PN532_I2C_Callback callback, uint16_t timeout);
+		uint8_t		finish(PN532_Status status);
+};
+
+#ifdef PN532_I2C_SCHEDULER
+
+// Interleaves the submitted commands of several readers sharing one bus.
+// Each run() makes one step on the next reader with a command in
+// progress, so a reader waiting for its card never holds the bus.
+class PN532_I2C_Scheduler {
+	public:
+					PN532_I2C_Scheduler(void);
+		bool		add(PN532_I2C * reader);
+		PN532_I2C *	run(void);
+		
+	private:
+		PN532_I2C *	_readers[PN532_SCHEDULER_MAX_READERS];
+		uint8_t		_count;
+		uint8_t		_next; // Reader served by the next run()
 };
 
+#endif
+
 #endif
\ No newline at end of file
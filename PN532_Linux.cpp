@@ -0,0 +1,190 @@
+/**************************************************************************/
+/*! 
+    @file     PN532_Linux.cpp
+    @author   teuteuguy
+	@license
+
+	Arduino compatibility functions for Linux userspace builds, see
+	PN532_Linux.h. Compiles to nothing in Arduino builds.
+*/
+/**************************************************************************/
+
+#if !defined(ARDUINO) && defined(__linux__)
+
+#include "PN532_Linux.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+static const char * pn532_gpio_chip = PN532_LINUX_GPIO_CHIP;
+static int pn532_gpio_chipfd = -1; // -2: could not be opened
+
+// Line request of each pin (file descriptor + 1, 0: not requested yet),
+// its direction, and the level last written to it (the output latch: an
+// output line is requested at that level)
+static int pn532_gpio_fd[256];
+static uint8_t pn532_gpio_mode[256];
+static uint8_t pn532_gpio_value[256];
+
+
+/**************************************************************************/
+/*! 
+    @brief  Time since an arbitrary start, from the monotonic clock
+*/
+/**************************************************************************/
+static uint64_t pn532_linux_now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long millis(void) {
+	return pn532_linux_now_us() / 1000;
+}
+
+unsigned long micros(void) {
+	return pn532_linux_now_us();
+}
+
+void delay(unsigned long ms) {
+	usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	usleep(us);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Selects the GPIO character device used for the pins. Must be
+            called before the first pin access (init()).
+
+    @param  path      For example "/dev/gpiochip0", or a gpio-sim chip
+*/
+/**************************************************************************/
+void pn532_linux_gpiochip(const char * path) {
+	pn532_gpio_chip = path;
+	if (pn532_gpio_chipfd == -2) pn532_gpio_chipfd = -1;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Requests the line of a pin from the kernel, on first use.
+            Inputs also report their falling edges, for
+            pn532_linux_waitfalling(); outputs start at the level last
+            written, so that RSTPD_N does not glitch low.
+
+    @returns  The line request file descriptor, or -1
+*/
+/**************************************************************************/
+static int pn532_gpio_line(uint8_t pin) {
+	struct gpio_v2_line_request req;
+
+	if (pn532_gpio_fd[pin]) return pn532_gpio_fd[pin] - 1;
+
+	if (pn532_gpio_chipfd == -1) {
+		pn532_gpio_chipfd = open(pn532_gpio_chip, O_RDWR | O_CLOEXEC);
+		if (pn532_gpio_chipfd < 0) {
+			// Reported once, the pins then stay unavailable
+			perror("PN532_Linux: gpiochip");
+			pn532_gpio_chipfd = -2;
+		}
+	}
+	if (pn532_gpio_chipfd < 0) return -1;
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = pin;
+	req.num_lines = 1;
+	strncpy(req.consumer, "pn532", sizeof(req.consumer) - 1);
+	if (pn532_gpio_mode[pin] == OUTPUT) {
+		req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		req.config.num_attrs = 1;
+		req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		req.config.attrs[0].attr.values = pn532_gpio_value[pin];
+		req.config.attrs[0].mask = 1;
+	} else {
+		req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	}
+
+	if (ioctl(pn532_gpio_chipfd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		perror("PN532_Linux: GPIO line");
+		return -1;
+	}
+	pn532_gpio_fd[pin] = req.fd + 1;
+	return req.fd;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+	if (pn532_gpio_fd[pin] && pn532_gpio_mode[pin] != mode) {
+		close(pn532_gpio_fd[pin] - 1);
+		pn532_gpio_fd[pin] = 0;
+	}
+	pn532_gpio_mode[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+	struct gpio_v2_line_values values;
+	int fd;
+
+	// Written to an input, the level is only latched for pinMode(OUTPUT)
+	pn532_gpio_value[pin] = value ? 1 : 0;
+	if (pn532_gpio_mode[pin] != OUTPUT) return;
+
+	fd = pn532_gpio_line(pin);
+	if (fd < 0) return;
+	values.bits = pn532_gpio_value[pin];
+	values.mask = 1;
+	ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+int digitalRead(uint8_t pin) {
+	struct gpio_v2_line_values values;
+	int fd = pn532_gpio_line(pin);
+
+	// A missing line reads high: the PN532 IRQ never looks ready
+	if (fd < 0) return HIGH;
+	values.bits = 0;
+	values.mask = 1;
+	if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) return HIGH;
+	return (values.bits & 1) ? HIGH : LOW;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Sleeps in poll() until a falling edge of an input pin, instead
+            of reading the pin in a loop. Edges already queued make it
+            return at once; the caller checks the pin level afterwards.
+
+    @param  pin       Input pin
+    @param  timeout   Time in ms to wait at most (0 waits forever)
+
+    @returns  true if an edge was seen
+*/
+/**************************************************************************/
+bool pn532_linux_waitfalling(uint8_t pin, uint16_t timeout) {
+	struct gpio_v2_line_event event;
+	struct pollfd pfd;
+	int fd = pn532_gpio_line(pin);
+	bool seen = false;
+
+	if (fd < 0) {
+		delay(1);
+		return false;
+	}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, seen ? 0 : (timeout ? (int)timeout : -1)) > 0) {
+		if (read(fd, &event, sizeof(event)) != sizeof(event)) break;
+		seen = true;
+	}
+	return seen;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*! 
+    @file     PN532_Linux.h
+    @author   teuteuguy
+	@license
+
+	The few Arduino functions the library uses, for Linux userspace
+	builds (no ARDUINO defined). Time comes from CLOCK_MONOTONIC, pins
+	are lines of a GPIO character device (/dev/gpiochipN, line offset =
+	pin number), and Serial prints to stdout.
+
+	Pins are requested from the kernel on first use, so
+	pn532_linux_gpiochip() can still be called after the PN532_I2C
+	objects are constructed, as long as it is before init().
+*/
+/**************************************************************************/
+
+#ifndef PN532_Linux_h
+#define PN532_Linux_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PN532_LINUX
+
+// GPIO character device whose line offsets are used as pin numbers
+#define PN532_LINUX_GPIO_CHIP               "/dev/gpiochip0"
+
+#define LOW                                 (0)
+#define HIGH                                (1)
+#define INPUT                               (0)
+#define OUTPUT                              (1)
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define F(s)                                (s)
+#define memcpy_P                            memcpy
+#define memcmp_P                            memcmp
+#define pgm_read_byte(addr)                 (*(const uint8_t *)(addr))
+#define pgm_read_dword(addr)                (*(const uint32_t *)(addr))
+
+unsigned long	millis(void);
+unsigned long	micros(void);
+void			delay(unsigned long ms);
+void			delayMicroseconds(unsigned int us);
+
+void			pinMode(uint8_t pin, uint8_t mode);
+void			digitalWrite(uint8_t pin, uint8_t value);
+int				digitalRead(uint8_t pin);
+
+void			pn532_linux_gpiochip(const char * path);
+bool			pn532_linux_waitfalling(uint8_t pin, uint16_t timeout);
+
+// Serial, printing to stdout
+#include "PN532_Print.h"
+
+#endif
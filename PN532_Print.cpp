@@ -0,0 +1,69 @@
+/**************************************************************************/
+/*! 
+    @file     PN532_Print.cpp
+    @author   teuteuguy
+	@license
+
+	Print on stdout, see PN532_Print.h. Compiles to nothing in Arduino
+	builds.
+*/
+/**************************************************************************/
+
+#if (!defined(ARDUINO) && defined(__linux__)) || defined(PN532_PRINT_STDOUT)
+
+#include "PN532_Print.h"
+
+#include <stdio.h>
+
+Print Serial;
+
+size_t Print::write(uint8_t c) {
+	return (fputc(c, stdout) == EOF) ? 0 : 1;
+}
+
+size_t Print::print(const char * s) {
+	size_t n = 0;
+	while (*s) n += write(*s++);
+	return n;
+}
+
+size_t Print::print(char c) {
+	return write(c);
+}
+
+size_t Print::print(unsigned char n, int base) {
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(int n, int base) {
+	return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(long n, int base) {
+	char buff[24];
+	if (base == HEX) snprintf(buff, sizeof(buff), "%lX", (unsigned long)n);
+	else snprintf(buff, sizeof(buff), "%ld", n);
+	return print(buff);
+}
+
+size_t Print::print(unsigned long n, int base) {
+	char buff[24];
+	snprintf(buff, sizeof(buff), (base == HEX) ? "%lX" : "%lu", n);
+	return print(buff);
+}
+
+size_t Print::print(double n, int digits) {
+	char buff[32];
+	snprintf(buff, sizeof(buff), "%.*f", digits, n);
+	return print(buff);
+}
+
+size_t Print::println(void) {
+	return print("\r\n");
+}
+
+#endif
@@ -0,0 +1,44 @@
+/**************************************************************************/
+/*! 
+    @file     PN532_Print.h
+    @author   teuteuguy
+	@license
+
+	As much of the Arduino Print class as the library uses, printing to
+	stdout, for the builds without an Arduino core: Linux userspace (see
+	PN532_Linux.h) and the host build of extras/host, which defines
+	PN532_PRINT_STDOUT.
+*/
+/**************************************************************************/
+
+#ifndef PN532_Print_h
+#define PN532_Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC                                 (10)
+#define HEX                                 (16)
+
+class Print {
+	public:
+		virtual		~Print(void) {}
+		virtual size_t	write(uint8_t c);
+
+		size_t		print(const char * s);
+		size_t		print(char c);
+		size_t		print(unsigned char n, int base = DEC);
+		size_t		print(int n, int base = DEC);
+		size_t		print(unsigned int n, int base = DEC);
+		size_t		print(long n, int base = DEC);
+		size_t		print(unsigned long n, int base = DEC);
+		size_t		print(double n, int digits = 2);
+
+		size_t		println(void);
+		template <typename T> size_t println(T value) { return print(value) + println(); }
+		template <typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+extern Print Serial;
+
+#endif
@@ -0,0 +1,629 @@
+/**************************************************************************/
+/*! 
+    @file     PN532_Transport.cpp
+    @author   teuteuguy
+	@license
+
+	I2C, SPI, HSU and Linux i2c-dev transports of the PN532_I2C library. Only the
+	transport selected with PN532_TRANSPORT is compiled.
+*/
+/**************************************************************************/
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#elif !defined(ARDUINO) && defined(__linux__)
+	#include "PN532_Linux.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "PN532_Transport.h"
+
+#if PN532_TRANSPORT == PN532_TRANSPORT_LINUX
+	#include <stdio.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/ioctl.h>
+	#include <linux/i2c.h>
+	#include <linux/i2c-dev.h>
+#endif
+
+#if PN532_TRANSPORT == PN532_TRANSPORT_I2C && defined(__AVR__) && defined(TWCR)
+	#include <util/twi.h>
+#endif
+
+
+#if PN532_TRANSPORT == PN532_TRANSPORT_I2C
+
+// Multiplexer channel currently selected on the bus, shared by all readers
+static uint8_t pn532_mux_address = PN532_I2C_NO_MUX;
+static uint8_t pn532_mux_channel = 0;
+
+/**************************************************************************/
+/*! 
+    @brief  Sends a buffer via I2C
+
+    @param  buff  The bytes to send
+    @param  n     Number of bytes
+*/
+/**************************************************************************/
+static inline void wiresendbuf(const uint8_t* buff, uint8_t n)
+{
+	#if ARDUINO >= 100
+		Wire.write(buff, n);
+	#else
+		Wire.send((uint8_t*)buff, n);
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads a single byte via I2C
+*/
+/**************************************************************************/
+static inline uint8_t wirerecv(void)
+{
+	#if ARDUINO >= 100
+		return Wire.read();
+	#else
+		return Wire.receive();
+	#endif
+}
+
+#if defined(__AVR__) && defined(TWCR)
+
+/**************************************************************************/
+/*! 
+    @brief  Waits for the TWI to finish the current bus operation
+
+    @returns  false if the bus hung
+*/
+/**************************************************************************/
+static bool pn532_twi_wait(void)
+{
+	uint16_t spins = PN532_I2C_TWI_SPINS;
+
+	while (!(TWCR & _BV(TWINT))) {
+		if (--spins == 0) return false;
+	}
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads a status byte and n data bytes in a single I2C read,
+            driving the AVR TWI directly. Wire is idle between its own
+            transfers; the TWI is handed back to it afterwards.
+
+    @param  address   7 bit I2C address
+    @param  status    Receives the first byte
+    @param  buff      Receives the n following bytes
+    @param  n         Number of data bytes
+
+    @returns  true if all the bytes were read
+*/
+/**************************************************************************/
+static bool pn532_twi_read(uint8_t address, uint8_t* status, uint8_t* buff, uint8_t n)
+{
+	uint16_t i = 0;
+	uint16_t spins = PN532_I2C_TWI_SPINS;
+
+	// I2C START, then the address with the read bit
+	TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+	if (pn532_twi_wait() && (TW_STATUS == TW_START || TW_STATUS == TW_REP_START)) {
+		TWDR = (address << 1) | TW_READ;
+		TWCR = _BV(TWINT) | _BV(TWEN);
+		if (pn532_twi_wait() && TW_STATUS == TW_MR_SLA_ACK) {
+			for (i=0; i<=n; i++) {
+				// ACK every byte but the last
+				TWCR = _BV(TWINT) | _BV(TWEN) | ((i < n) ? _BV(TWEA) : 0);
+				if (!pn532_twi_wait()) break;
+				if (i == 0) *status = TWDR;
+				else buff[i-1] = TWDR;
+			}
+		}
+	}
+
+	// I2C STOP
+	TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+	while ((TWCR & _BV(TWSTO)) && --spins);
+	TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+
+	return i > n;
+}
+
+#endif
+
+/**************************************************************************/
+/*! 
+    @brief  Creates an I2C transport
+
+    @param  address   7 bit I2C address of the PN532
+*/
+/**************************************************************************/
+PN532_I2CTransport::PN532_I2CTransport(uint8_t address) {
+	_address = address;
+	_mux_address = PN532_I2C_NO_MUX;
+	_mux_channel = 0;
+	_bytes = 0;
+	_short = false;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Places the PN532 behind an I2C multiplexer (TCA9548A style:
+            one bit per channel in a single control byte)
+
+    @param  mux_address   7 bit I2C address of the multiplexer
+    @param  channel       Multiplexer channel the PN532 is wired to (0-7)
+*/
+/**************************************************************************/
+void PN532_I2CTransport::setMux(uint8_t mux_address, uint8_t channel) {
+	_mux_address = mux_address;
+	_mux_channel = channel;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Selects the multiplexer channel of this PN532 before a
+            transfer, if another channel is selected. A channel left open
+            on another multiplexer is closed first, so that two PN532 at
+            the same address are never on the bus together.
+*/
+/**************************************************************************/
+void PN532_I2CTransport::selectMux(void) {
+	uint8_t control = 0;
+
+	if (pn532_mux_address == _mux_address && pn532_mux_channel == _mux_channel) return;
+
+	if (pn532_mux_address != PN532_I2C_NO_MUX && pn532_mux_address != _mux_address) {
+		Wire.beginTransmission(pn532_mux_address);
+		wiresendbuf(&control, 1);
+		Wire.endTransmission();
+		_bytes += 1;
+	}
+
+	if (_mux_address != PN532_I2C_NO_MUX) {
+		control = 1 << _mux_channel;
+		Wire.beginTransmission(_mux_address);
+		wiresendbuf(&control, 1);
+		Wire.endTransmission();
+		_bytes += 1;
+	}
+
+	pn532_mux_address = _mux_address;
+	pn532_mux_channel = _mux_channel;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Starts the I2C bus
+
+    @param  clock     I2C clock in Hz (PN532_I2C_CLOCK_STANDARD or
+                      PN532_I2C_CLOCK_FAST)
+*/
+/**************************************************************************/
+void PN532_I2CTransport::begin(uint32_t clock) {
+	Wire.begin();
+	#if defined(ARDUINO) && ARDUINO >= 10600
+		Wire.setClock(clock);
+	#elif defined(TWBR)
+		TWBR = ((F_CPU / clock) - 16) / 2;
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes n raw bytes to the PN532 in one I2C transfer
+
+    @param  buff      Pointer to the bytes
+    @param  n         Number of bytes
+*/
+/**************************************************************************/
+void PN532_I2CTransport::write(const uint8_t* buff, uint8_t n) {
+	selectMux();
+
+	// I2C START
+	Wire.beginTransmission(_address);
+	wiresendbuf(buff, n);
+	// I2C STOP
+	Wire.endTransmission();
+	_bytes += n;
+	_short = false;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads n bytes of data from the PN532 via I2C, in one transfer
+            led by the PN532 status byte
+
+    The PN532 starts its frame over on every read, so the frame cannot be
+    split in several Wire reads. On AVR the TWI is driven directly, past
+    the 32 byte Wire buffer; other cores read through Wire, and the frame
+    layer never asks them for more than PN532_I2C_READ_MAX bytes. A core
+    that still returns fewer bytes than asked, its buffer being smaller
+    than the macros it defines tell, makes shortRead() true until the
+    next write.
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Number of bytes to be read
+
+    @returns  false if the PN532 was not ready or the read failed
+*/
+/**************************************************************************/
+bool PN532_I2CTransport::read(uint8_t* buff, uint8_t n) {
+	uint8_t status;
+
+	selectMux();
+	_bytes += n + 1;
+
+	#if defined(__AVR__) && defined(TWCR)
+		return pn532_twi_read(_address, &status, buff, n) && (status & PN532_I2C_READY);
+	#else
+		if (Wire.requestFrom(_address, (uint8_t)(n+1)) != n + 1) {
+			// A busy PN532 still sends its status byte and whatever follows:
+			// fewer bytes on a read longer than a status read is the buffer
+			if (n >= PN532_I2C_WIRE_BUFSIZ) _short = true;
+			while (Wire.available()) wirerecv();
+			return false;
+		}
+		status = wirerecv();
+		for (uint8_t i=0; i<n; i++) {
+			buff[i] = wirerecv();
+		}
+		return status & PN532_I2C_READY;
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Wakes the PN532 up with an address only I2C transfer
+*/
+/**************************************************************************/
+void PN532_I2CTransport::wake(void) {
+	selectMux();
+	
+	Wire.beginTransmission(_address);
+	Wire.endTransmission();
+	_bytes += 1;
+}
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_SPI
+
+/**************************************************************************/
+/*! 
+    @brief  Creates an SPI transport
+
+    @param  ss        Chip select pin of the PN532
+*/
+/**************************************************************************/
+PN532_SPITransport::PN532_SPITransport(uint8_t ss) {
+	_ss = ss;
+	_clock = PN532_SPI_CLOCK;
+	_bytes = 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Starts the SPI bus
+
+    @param  clock     SPI clock in Hz, at most PN532_SPI_CLOCK. Without
+                      SPI transactions, the fastest clock divider of
+                      F_CPU not above it (DIV4 if F_CPU is unknown).
+*/
+/**************************************************************************/
+void PN532_SPITransport::begin(uint32_t clock) {
+	_clock = clock;
+
+	pinMode(_ss, OUTPUT);
+	digitalWrite(_ss, HIGH);
+	SPI.begin();
+	#ifndef SPI_HAS_TRANSACTION
+		// The PN532 talks LSB first, in SPI mode 0
+		SPI.setBitOrder(LSBFIRST);
+		SPI.setDataMode(SPI_MODE0);
+		#ifdef F_CPU
+			if (clock >= F_CPU / 2) SPI.setClockDivider(SPI_CLOCK_DIV2);
+			else if (clock >= F_CPU / 4) SPI.setClockDivider(SPI_CLOCK_DIV4);
+			else if (clock >= F_CPU / 8) SPI.setClockDivider(SPI_CLOCK_DIV8);
+			else if (clock >= F_CPU / 16) SPI.setClockDivider(SPI_CLOCK_DIV16);
+			else if (clock >= F_CPU / 32) SPI.setClockDivider(SPI_CLOCK_DIV32);
+			else if (clock >= F_CPU / 64) SPI.setClockDivider(SPI_CLOCK_DIV64);
+			else SPI.setClockDivider(SPI_CLOCK_DIV128);
+		#else
+			SPI.setClockDivider(SPI_CLOCK_DIV4);
+		#endif
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Asserts the chip select of the PN532
+*/
+/**************************************************************************/
+void PN532_SPITransport::select(void) {
+	#ifdef SPI_HAS_TRANSACTION
+		SPI.beginTransaction(SPISettings(_clock, LSBFIRST, SPI_MODE0));
+	#endif
+	digitalWrite(_ss, LOW);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Releases the chip select of the PN532
+*/
+/**************************************************************************/
+void PN532_SPITransport::deselect(void) {
+	digitalWrite(_ss, HIGH);
+	#ifdef SPI_HAS_TRANSACTION
+		SPI.endTransaction();
+	#endif
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes n raw bytes to the PN532 in one SPI data write
+
+    @param  buff      Pointer to the bytes
+    @param  n         Number of bytes
+*/
+/**************************************************************************/
+void PN532_SPITransport::write(const uint8_t* buff, uint8_t n) {
+	select();
+	SPI.transfer(PN532_SPI_DATAWRITE);
+	for (uint8_t i=0; i<n; i++) {
+		SPI.transfer(buff[i]);
+	}
+	deselect();
+	_bytes += n + 1;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads n bytes of data from the PN532 in one SPI data read.
+            SPI data reads have no status byte, so a status read comes
+            first.
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Number of bytes to be read
+
+    @returns  false if the PN532 was not ready (nothing read)
+*/
+/**************************************************************************/
+bool PN532_SPITransport::read(uint8_t* buff, uint8_t n) {
+	uint8_t status;
+	
+	select();
+	SPI.transfer(PN532_SPI_STATUSREAD);
+	status = SPI.transfer(0x00);
+	deselect();
+	_bytes += 2;
+	if (!(status & PN532_I2C_READY)) return false;
+	
+	select();
+	SPI.transfer(PN532_SPI_DATAREAD);
+	for (uint8_t i=0; i<n; i++) {
+		buff[i] = SPI.transfer(0x00);
+	}
+	deselect();
+	_bytes += n + 1;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Wakes the PN532 up by pulsing its chip select
+*/
+/**************************************************************************/
+void PN532_SPITransport::wake(void) {
+	select();
+	deselect();
+}
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_HSU
+
+// Sent before a frame to wake the PN532 up from power down
+static const uint8_t pn532_hsu_wakeup[] PROGMEM = { 0x55, 0x55, 0x00, 0x00, 0x00 };
+
+/**************************************************************************/
+/*! 
+    @brief  Creates an HSU transport on PN532_HSU_SERIAL
+*/
+/**************************************************************************/
+PN532_HSUTransport::PN532_HSUTransport(uint8_t) {
+	_bytes = 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Opens the serial port
+
+    @param  baud      Baud rate, PN532_HSU_BAUD after a PN532 reset
+*/
+/**************************************************************************/
+void PN532_HSUTransport::begin(uint32_t baud) {
+	PN532_HSU_SERIAL.begin(baud);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes n raw bytes to the PN532
+
+    @param  buff      Pointer to the bytes
+    @param  n         Number of bytes
+*/
+/**************************************************************************/
+void PN532_HSUTransport::write(const uint8_t* buff, uint8_t n) {
+	// Drop what is left of an earlier frame
+	while (PN532_HSU_SERIAL.available()) PN532_HSU_SERIAL.read();
+
+	PN532_HSU_SERIAL.write(buff, n);
+	_bytes += n;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads the next n bytes sent by the PN532, if they all arrived.
+            Never waits.
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Number of bytes to be read
+
+    @returns  false if fewer than n bytes are waiting (nothing read)
+*/
+/**************************************************************************/
+bool PN532_HSUTransport::read(uint8_t* buff, uint8_t n) {
+	if (PN532_HSU_SERIAL.available() < n) return false;
+
+	PN532_HSU_SERIAL.readBytes((char *)buff, n);
+	_bytes += n;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads up to n bytes, as many as have arrived. Never waits.
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Largest number of bytes to read
+
+    @returns  The number of bytes read
+*/
+/**************************************************************************/
+uint8_t PN532_HSUTransport::readAvailable(uint8_t* buff, uint8_t n) {
+	uint8_t got = 0;
+
+	while (got < n && PN532_HSU_SERIAL.available() > 0) {
+		buff[got++] = PN532_HSU_SERIAL.read();
+	}
+	_bytes += got;
+	return got;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Wakes the PN532 up with the HSU wake up sequence
+*/
+/**************************************************************************/
+void PN532_HSUTransport::wake(void) {
+	for (uint8_t i=0; i<sizeof(pn532_hsu_wakeup); i++) {
+		PN532_HSU_SERIAL.write(pgm_read_byte(&pn532_hsu_wakeup[i]));
+	}
+	_bytes += sizeof(pn532_hsu_wakeup);
+}
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_LINUX
+
+/**************************************************************************/
+/*! 
+    @brief  Creates a Linux i2c-dev transport on PN532_LINUX_I2C_DEVICE
+
+    @param  address   7 bit I2C address of the PN532
+*/
+/**************************************************************************/
+PN532_LinuxTransport::PN532_LinuxTransport(uint8_t address) {
+	_device = PN532_LINUX_I2C_DEVICE;
+	_fd = -1;
+	_address = address;
+	_bytes = 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Selects the I2C bus, before begin()
+
+    @param  path      For example "/dev/i2c-0"
+*/
+/**************************************************************************/
+void PN532_LinuxTransport::setDevice(const char * path) {
+	_device = path;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Opens the I2C bus. The bus clock is set by the kernel (device
+            tree), the clock argument is ignored.
+*/
+/**************************************************************************/
+void PN532_LinuxTransport::begin(uint32_t) {
+	if (_fd >= 0) close(_fd);
+	
+	_fd = open(_device, O_RDWR | O_CLOEXEC);
+	if (_fd < 0) perror("PN532_LinuxTransport: open");
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Moves n bytes in a single kernel transfer: one I2C_RDWR
+            message on i2c-dev. n goes up to 256, a full frame and its
+            status byte.
+
+    @returns  false if the transfer failed
+*/
+/**************************************************************************/
+bool PN532_LinuxTransport::transfer(bool read, uint8_t* buff, uint16_t n) {
+	if (_fd < 0) return false;
+	
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data data;
+	
+	msg.addr = _address;
+	msg.flags = read ? I2C_M_RD : 0;
+	msg.len = n;
+	msg.buf = buff;
+	data.msgs = &msg;
+	data.nmsgs = 1;
+	if (ioctl(_fd, I2C_RDWR, &data) != 1) return false;
+	
+	// Only bytes that went over the bus count
+	_bytes += n;
+	return true;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Writes n raw bytes to the PN532 in one I2C transfer
+
+    @param  buff      Pointer to the bytes
+    @param  n         Number of bytes
+*/
+/**************************************************************************/
+void PN532_LinuxTransport::write(const uint8_t* buff, uint8_t n) {
+	transfer(false, (uint8_t *)buff, n);
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Reads n bytes of data from the PN532 in one I2C transfer,
+            whatever n: the kernel has no 32 byte Wire buffer
+
+    @param  buff      Pointer to the buffer where data will be written
+    @param  n         Number of bytes to be read
+
+    @returns  false if the transfer failed or the PN532 was not ready
+*/
+/**************************************************************************/
+bool PN532_LinuxTransport::read(uint8_t* buff, uint8_t n) {
+	uint8_t data[256];
+	
+	// Leading status byte
+	if (!transfer(true, data, (uint16_t)n + 1)) return false;
+	
+	memcpy(buff, data + 1, n);
+	return (data[0] & PN532_I2C_READY) != 0;
+}
+
+/**************************************************************************/
+/*! 
+    @brief  Wakes the PN532 up with a one byte I2C write. Many adapters
+            reject the zero length transfer of the other transports
+            (I2C_AQ_NO_ZERO_LEN); the 0x00 is taken as a preamble byte.
+*/
+/**************************************************************************/
+void PN532_LinuxTransport::wake(void) {
+	uint8_t dummy = 0x00;
+	
+	transfer(false, &dummy, 1);
+}
+
+#endif
@@ -0,0 +1,271 @@
+/**************************************************************************/
+/*! 
+    @file     PN532_Transport.h
+    @author   teuteuguy
+	@license
+
+	Byte level access to the PN532 over I2C, SPI, HSU (UART) or Linux
+	i2c-dev, or through a transport of the application. The
+	transport is chosen at compile time with PN532_TRANSPORT, so the
+	frame and command logic of PN532_I2C calls it directly, without
+	virtual functions.
+
+	Every transport has the same members:
+
+	    void      begin(uint32_t clock);
+	    void      write(const uint8_t* buff, uint8_t n);
+	    bool      read(uint8_t* buff, uint8_t n); // false if not ready
+	    void      wake(void); // Wakes the PN532 up from PowerDown
+	    uint32_t  getBytes(void);
+	    void      resetBytes(void);
+
+	A transport whose reads can come back short of what was asked also
+	defines PN532_TRANSPORT_SHORT_READS and has
+
+	    bool      shortRead(void); // A read since the last write came back short
+*/
+/**************************************************************************/
+
+#ifndef PN532_Transport_h
+#define PN532_Transport_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#elif !defined(ARDUINO) && defined(__linux__)
+	#include "PN532_Linux.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#define PN532_TRANSPORT_I2C                 (0)
+#define PN532_TRANSPORT_SPI                 (1)
+#define PN532_TRANSPORT_HSU                 (2)
+#define PN532_TRANSPORT_LINUX               (3) // Default of Linux userspace builds
+#define PN532_TRANSPORT_CUSTOM              (4) // Declared in PN532_TRANSPORT_HEADER
+
+// Uncomment one to talk to the PN532 over SPI or HSU instead of I2C
+//#define PN532_TRANSPORT                     PN532_TRANSPORT_SPI
+//#define PN532_TRANSPORT                     PN532_TRANSPORT_HSU
+
+#ifndef PN532_TRANSPORT
+	#ifdef PN532_LINUX
+		#define PN532_TRANSPORT             PN532_TRANSPORT_LINUX
+	#else
+		#define PN532_TRANSPORT             PN532_TRANSPORT_I2C
+	#endif
+#endif
+
+#define PN532_I2C_ADDRESS                   (0x48 >> 1)
+#define PN532_I2C_BUSY                      (0x00)
+#define PN532_I2C_READY                     (0x01)
+
+// No I2C multiplexer in front of the PN532
+#define PN532_I2C_NO_MUX                    (0xFF)
+
+// I2C bus clock, passed to init()
+#define PN532_I2C_CLOCK_STANDARD            (100000UL)
+#define PN532_I2C_CLOCK_FAST                (400000UL)
+
+// Largest transfer the Wire library can buffer. Also the largest frame
+// written in one transfer, whatever the transport. Reads are not bound
+// by it on AVR, where they drive the TWI directly.
+#ifdef BUFFER_LENGTH
+	#define PN532_I2C_WIRE_BUFSIZ           (BUFFER_LENGTH)
+#else
+	#define PN532_I2C_WIRE_BUFSIZ           (32)
+#endif
+
+// Busy-wait iterations allowed for one byte of a direct TWI read
+#define PN532_I2C_TWI_SPINS                 (20000U)
+
+// SPI clock (the PN532 handles up to 5 MHz) and HSU baud rate
+#define PN532_SPI_CLOCK                     (5000000UL)
+#define PN532_HSU_BAUD                      (115200UL)
+
+// SPI operations, first byte of every SPI transfer
+#define PN532_SPI_DATAWRITE                 (0x01)
+#define PN532_SPI_STATUSREAD                (0x02)
+#define PN532_SPI_DATAREAD                  (0x03)
+
+// Serial port wired to the PN532 in HSU mode
+#ifndef PN532_HSU_SERIAL
+	#define PN532_HSU_SERIAL                Serial1
+#endif
+
+// Time in ms allowed between two bytes of an HSU frame
+#define PN532_HSU_TIMEOUT                   (10)
+
+// I2C bus of the PN532 on Linux
+#define PN532_LINUX_I2C_DEVICE              "/dev/i2c-1"
+
+#if PN532_TRANSPORT == PN532_TRANSPORT_I2C
+
+	#include <Wire.h>
+
+	// Default of the address argument of the PN532_I2C constructor, and
+	// default of the clock argument of init()
+	#define PN532_TRANSPORT_ADDRESS         PN532_I2C_ADDRESS
+	#define PN532_TRANSPORT_CLOCK           PN532_I2C_CLOCK_STANDARD
+	#define PN532_TRANSPORT_WAKEUP          PN532_WAKEUP_I2C
+
+	// Longest frame one read returns. The PN532 starts its frame over on
+	// every read, so a frame must fit a single transfer: unbounded on AVR,
+	// where the TWI is driven directly, the Wire receive buffer less the
+	// status byte elsewhere, as the core tells it (I2C_BUFFER_LENGTH on
+	// ESP32, WIRE_BUFFER_SIZE on RP2040, SERIAL_BUFFER_SIZE, the size of
+	// the SAMD ring buffer, BUFFER_LENGTH on AVR style cores). A core that
+	// tells none gets 0xFF, and a read it cannot take comes back short.
+	// Set it with -D to override. A longer frame, or a short read, fails
+	// with PN532_ERROR_OVERFLOW.
+	#define PN532_I2C_READ_FIT(size)    (((size) > 0x100) ? 0xFF : ((size) - 1))
+	#ifndef PN532_I2C_READ_MAX
+		#if defined(__AVR__) && defined(TWCR)
+			#define PN532_I2C_READ_MAX      (0xFF)
+		#elif defined(I2C_BUFFER_LENGTH)
+			#define PN532_I2C_READ_MAX      PN532_I2C_READ_FIT(I2C_BUFFER_LENGTH)
+		#elif defined(WIRE_BUFFER_SIZE)
+			#define PN532_I2C_READ_MAX      PN532_I2C_READ_FIT(WIRE_BUFFER_SIZE)
+		#elif defined(ARDUINO_ARCH_SAMD) && defined(SERIAL_BUFFER_SIZE)
+			#define PN532_I2C_READ_MAX      PN532_I2C_READ_FIT(SERIAL_BUFFER_SIZE)
+		#elif defined(BUFFER_LENGTH)
+			#define PN532_I2C_READ_MAX      PN532_I2C_READ_FIT(BUFFER_LENGTH)
+		#else
+			#define PN532_I2C_READ_MAX      (0xFF)
+		#endif
+	#endif
+	#define PN532_TRANSPORT_READ_MAX        PN532_I2C_READ_MAX
+
+	// Reads through Wire can come back shorter than asked: shortRead()
+	// tells the frame layer
+	#if !(defined(__AVR__) && defined(TWCR))
+		#define PN532_TRANSPORT_SHORT_READS
+	#endif
+
+	class PN532_I2CTransport {
+		public:
+						PN532_I2CTransport(uint8_t address);
+			void		setMux(uint8_t mux_address, uint8_t channel);
+			void		begin(uint32_t clock);
+			void		write(const uint8_t* buff, uint8_t n);
+			bool		read(uint8_t* buff, uint8_t n);
+			bool		shortRead(void) { return _short; }
+			void		wake(void);
+			uint32_t	getBytes(void) { return _bytes; }
+			void		resetBytes(void) { _bytes = 0; }
+
+		private:
+			uint8_t		_address; // 7 bit I2C address
+			bool		_short; // A read since the last write got fewer bytes than asked
+			uint8_t		_mux_address, _mux_channel; // I2C multiplexer, if any
+			uint32_t	_bytes; // Bytes moved on the bus
+
+			void		selectMux(void);
+	};
+
+	typedef PN532_I2CTransport PN532_TransportType;
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_SPI
+
+	#include <SPI.h>
+
+	#define PN532_TRANSPORT_ADDRESS         (SS)
+	#define PN532_TRANSPORT_CLOCK           PN532_SPI_CLOCK
+	#define PN532_TRANSPORT_WAKEUP          PN532_WAKEUP_SPI
+	#define PN532_TRANSPORT_READ_MAX        (0xFF)
+
+	class PN532_SPITransport {
+		public:
+						PN532_SPITransport(uint8_t ss);
+			void		begin(uint32_t clock);
+			void		write(const uint8_t* buff, uint8_t n);
+			bool		read(uint8_t* buff, uint8_t n);
+			void		wake(void);
+			uint32_t	getBytes(void) { return _bytes; }
+			void		resetBytes(void) { _bytes = 0; }
+
+		private:
+			uint8_t		_ss; // Chip select pin
+			uint32_t	_clock;
+			uint32_t	_bytes;
+
+			void		select(void);
+			void		deselect(void);
+	};
+
+	typedef PN532_SPITransport PN532_TransportType;
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_HSU
+
+	#define PN532_TRANSPORT_ADDRESS         (0)
+	#define PN532_TRANSPORT_CLOCK           PN532_HSU_BAUD
+	#define PN532_TRANSPORT_WAKEUP          PN532_WAKEUP_HSU
+	#define PN532_TRANSPORT_READ_MAX        (0xFF)
+
+	// The UART delivers a frame as one stream: the rest of a frame can be
+	// read after its header, no NACK / resend is needed. The bytes waiting
+	// in the UART buffer are the readiness check, and a frame longer than
+	// that buffer is taken piece by piece with readAvailable().
+	#define PN532_TRANSPORT_STREAM
+
+	class PN532_HSUTransport {
+		public:
+						PN532_HSUTransport(uint8_t unused);
+			void		begin(uint32_t baud);
+			void		write(const uint8_t* buff, uint8_t n);
+			bool		read(uint8_t* buff, uint8_t n);
+			uint8_t		readAvailable(uint8_t* buff, uint8_t n);
+			void		wake(void);
+			uint32_t	getBytes(void) { return _bytes; }
+			void		resetBytes(void) { _bytes = 0; }
+
+		private:
+			uint32_t	_bytes;
+	};
+
+	typedef PN532_HSUTransport PN532_TransportType;
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_LINUX
+
+	#define PN532_TRANSPORT_ADDRESS         PN532_I2C_ADDRESS
+	#define PN532_TRANSPORT_CLOCK           PN532_I2C_CLOCK_STANDARD
+	#define PN532_TRANSPORT_WAKEUP          PN532_WAKEUP_I2C
+	#define PN532_TRANSPORT_READ_MAX        (0xFF)
+
+	class PN532_LinuxTransport {
+		public:
+						PN532_LinuxTransport(uint8_t address);
+			void		setDevice(const char * path);
+			void		begin(uint32_t clock);
+			void		write(const uint8_t* buff, uint8_t n);
+			bool		read(uint8_t* buff, uint8_t n);
+			void		wake(void);
+			uint32_t	getBytes(void) { return _bytes; }
+			void		resetBytes(void) { _bytes = 0; }
+
+		private:
+			const char *	_device;
+			int			_fd;
+			uint8_t		_address;
+			uint32_t	_bytes;
+
+			bool		transfer(bool read, uint8_t* buff, uint16_t n);
+	};
+
+	typedef PN532_LinuxTransport PN532_TransportType;
+
+#elif PN532_TRANSPORT == PN532_TRANSPORT_CUSTOM
+
+	// A transport of the application, e.g. the mock of the host tests: its
+	// header defines PN532_TRANSPORT_ADDRESS, _CLOCK, _WAKEUP and _READ_MAX
+	// (and _STREAM or _SHORT_READS if it has one) as above, and typedefs
+	// its class as PN532_TransportType
+	#ifndef PN532_TRANSPORT_HEADER
+		#error "PN532_TRANSPORT_CUSTOM needs PN532_TRANSPORT_HEADER, the header of the transport"
+	#endif
+	#include PN532_TRANSPORT_HEADER
+
+#else
+	#error "PN532_TRANSPORT must be PN532_TRANSPORT_I2C, PN532_TRANSPORT_SPI, PN532_TRANSPORT_HSU, PN532_TRANSPORT_LINUX or PN532_TRANSPORT_CUSTOM"
+#endif
+
+#endif
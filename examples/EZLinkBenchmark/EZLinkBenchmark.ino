@@ -0,0 +1,75 @@
+/**************************************************************************/
+/*!
+    @file     EZLinkBenchmark.ino
+    @author   teuteuguy
+	@license
+
+	Measures the latency and I2C traffic of the PN532_I2C library.
+
+	For every init(), checkForEZLink() and checkForEZLink_Transparent()
+	cycle the sketch prints one line:
+
+	    <name> <result> <milliseconds> <I2C bytes>
+
+	Keep a card on the reader to measure the full read path, or leave
+	the field empty to measure the detection timeout path.
+*/
+/**************************************************************************/
+#include <Wire.h>
+#include <PN532_I2C.h>
+
+#define IRQ   (2)
+#define RESET (3)
+
+// Number of cycles measured per loop() for each API.
+#define BENCHMARK_CYCLES (10)
+
+PN532_I2C nfc(IRQ, RESET);
+
+void report(const char * name, bool result, uint32_t elapsed) {
+	Serial.print(name);
+	Serial.print(" ");
+	Serial.print(result ? "ok" : "fail");
+	Serial.print(" ");
+	Serial.print(elapsed);
+	Serial.print(" ");
+	Serial.println(nfc.getBusBytes());
+}
+
+void setup(void) {
+	Serial.begin(115200);
+	Serial.println("PN532_I2C benchmark: <name> <result> <ms> <bytes>");
+
+	nfc.resetBusBytes();
+	uint32_t start = millis();
+	bool ok = nfc.init();
+	report("init", ok, millis() - start);
+
+	if (!ok) {
+		Serial.println("PN532 not found, halting.");
+		while (1);
+	}
+}
+
+void loop(void) {
+	PN532_Purse purse;
+
+	for (uint8_t i = 0; i < BENCHMARK_CYCLES; i++) {
+		nfc.resetBusBytes();
+		uint32_t start = millis();
+		bool ok = nfc.checkForEZLink(&purse);
+		report("checkForEZLink", ok, millis() - start);
+	}
+
+	for (uint8_t i = 0; i < BENCHMARK_CYCLES; i++) {
+		// A transparent cycle ends when the state machine has walked
+		// through search, read and release, or after 5 seconds.
+		nfc.resetBusBytes();
+		uint32_t start = millis();
+		bool ok = false;
+		while (!ok && millis() - start < 5000) {
+			ok = nfc.checkForEZLink_Transparent(&purse);
+		}
+		report("checkForEZLink_Transparent", ok, millis() - start);
+	}
+}
@@ -0,0 +1,120 @@
+/**************************************************************************/
+/*!
+    @file     Footprint.ino
+    @author   teuteuguy
+	@license
+
+	Reports the RAM taken by the PN532_I2C library on the target MCU, one
+	line per figure:
+
+	    <name> <bytes>
+
+	"reader" is the static RAM of one PN532_I2C object, "buffer" its
+	receive buffer (inside it, or shared by all readers with
+	PN532_MINIMAL), and each API line the stack high-water mark
+	of one call (AVR only, measured by painting the free RAM before the
+	call). "free" is the RAM left between heap and stack afterwards.
+
+	Flash per API: build the sketch once for each FOOTPRINT_API value
+	and compare the program sizes reported by the IDE. Build with
+	PN532_MINIMAL uncommented in PN532_I2C.h to see the small profile
+	(not #defined here: the library would not be built with it).
+	extras/host "make footprint" gives all of it on the host.
+*/
+/**************************************************************************/
+#include <Wire.h>
+#include <PN532_I2C.h>
+
+#define IRQ   (2)
+#define RESET (3)
+
+// API measured besides init(): 0 none, 1 checkForEZLink(),
+// 2 checkForEZLink_Transparent(), 3 watchEZLink(), 4 pollLowPower(),
+// 5 readCard() with the EZLink handler
+#define FOOTPRINT_API (1)
+
+// Value painted over the free RAM
+#define FOOTPRINT_PAINT (0xA5)
+
+PN532_I2C nfc(IRQ, RESET);
+PN532_Purse purse;
+
+#if defined(__AVR__)
+extern char __heap_start;
+extern char * __brkval;
+
+static uint8_t * painted_top;
+
+uint8_t * freeStart(void) {
+	return (uint8_t *)(__brkval ? __brkval : &__heap_start);
+}
+
+void paintStack(void) {
+	uint8_t * p = freeStart();
+
+	// Keep clear of this function's own frame
+	painted_top = (uint8_t *)SP - 16;
+	while (p < painted_top) *p++ = FOOTPRINT_PAINT;
+}
+
+uint16_t stackUsed(void) {
+	uint8_t * p = freeStart();
+
+	while (p < painted_top && *p == FOOTPRINT_PAINT) p++;
+	return painted_top - p;
+}
+
+uint16_t freeRam(void) {
+	return (uint8_t *)SP - freeStart();
+}
+#else
+// No portable way to find the stack, only the static figures are exact
+void paintStack(void) {}
+uint16_t stackUsed(void) { return 0; }
+uint16_t freeRam(void) { return 0; }
+#endif
+
+void report(const __FlashStringHelper * name, uint32_t bytes) {
+	Serial.print(name);
+	Serial.print(" ");
+	Serial.println(bytes);
+}
+
+void setup(void) {
+	Serial.begin(115200);
+	Serial.println(F("PN532_I2C footprint: <name> <bytes>"));
+
+	report(F("reader"), sizeof(PN532_I2C));
+	report(F("buffer"), PN532_PACKBUFFSIZ);
+
+	paintStack();
+	bool ok = nfc.init();
+	report(F("init"), stackUsed());
+	if (!ok) Serial.println(F("PN532 not found, API figures are partial"));
+
+	paintStack();
+	#if FOOTPRINT_API == 1
+		nfc.checkForEZLink(&purse);
+		report(F("checkForEZLink"), stackUsed());
+	#elif FOOTPRINT_API == 2
+		uint32_t start = millis();
+		while (!nfc.checkForEZLink_Transparent(&purse) && millis() - start < 2000);
+		report(F("checkForEZLink_Transparent"), stackUsed());
+	#elif FOOTPRINT_API == 3
+		nfc.watchEZLink(&purse);
+		report(F("watchEZLink"), stackUsed());
+	#elif FOOTPRINT_API == 4
+		nfc.pollLowPower(&purse);
+		report(F("pollLowPower"), stackUsed());
+	#elif FOOTPRINT_API == 5
+		uint32_t start = millis();
+		nfc.addCardHandler(PN532_TARGET_ISO14443_4B, PN532_I2C::readEZLinkCard, &purse);
+		while (nfc.readCard() == 0 && millis() - start < 2000);
+		report(F("readCard"), stackUsed());
+	#endif
+
+	report(F("free"), freeRam());
+}
+
+void loop(void) {
+}
@@ -0,0 +1,56 @@
+/**************************************************************************/
+/*!
+    @file     Arduino.h
+    @author   teuteuguy
+	@license
+
+	The few Arduino core functions the library uses, for the host build
+	in extras/host. Time is a virtual clock that only moves when the
+	library waits or talks to the bus, pins and Wire are wired to the
+	simulated PN532 of pn532_sim.cpp, and Serial prints to stdout.
+*/
+/**************************************************************************/
+
+#ifndef PN532_Host_Arduino_h
+#define PN532_Host_Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOW                                 (0)
+#define HIGH                                (1)
+#define INPUT                               (0)
+#define OUTPUT                              (1)
+#define FALLING                             (2)
+
+#define NOT_AN_INTERRUPT                    (-1)
+#define digitalPinToInterrupt(pin)          ((int8_t)(pin))
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define F(s)                                (s)
+#define memcpy_P                            memcpy
+#define memcmp_P                            memcmp
+#define pgm_read_byte(addr)                 (*(const uint8_t *)(addr))
+#define pgm_read_dword(addr)                (*(const uint32_t *)(addr))
+
+unsigned long	millis(void);
+unsigned long	micros(void);
+void			delay(unsigned long ms);
+void			delayMicroseconds(unsigned int us);
+
+void			pinMode(uint8_t pin, uint8_t mode);
+void			digitalWrite(uint8_t pin, uint8_t value);
+int				digitalRead(uint8_t pin);
+
+void			attachInterrupt(uint8_t irq, void (*handler)(void), int mode);
+void			detachInterrupt(uint8_t irq);
+
+// Serial, printing to stdout
+#include "PN532_Print.h"
+
+#endif
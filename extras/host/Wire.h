@@ -0,0 +1,40 @@
+/**************************************************************************/
+/*!
+    @file     Wire.h
+    @author   teuteuguy
+	@license
+
+	Wire library of the host build: every transfer goes to the
+	simulated PN532 of pn532_sim.cpp and takes the virtual time it would
+	take on the bus at the clock set with setClock().
+
+	BUFFER_LENGTH is the AVR one, so that frame writes are sized as on
+	an ATmega. Reads are not bounded by it, as the AVR direct TWI read.
+*/
+/**************************************************************************/
+
+#ifndef PN532_Host_Wire_h
+#define PN532_Host_Wire_h
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH                       (32)
+
+class TwoWire {
+	public:
+		void		begin(void);
+		void		setClock(uint32_t clock);
+
+		void		beginTransmission(uint8_t address);
+		size_t		write(uint8_t c);
+		size_t		write(const uint8_t * buff, size_t n);
+		uint8_t		endTransmission(bool stop = true);
+
+		uint8_t		requestFrom(uint8_t address, uint8_t n);
+		int			available(void);
+		int			read(void);
+};
+
+extern TwoWire Wire;
+
+#endif
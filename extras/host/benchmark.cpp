@@ -0,0 +1,297 @@
+/**************************************************************************/
+/*!
+    @file     benchmark.cpp
+    @author   teuteuguy
+	@license
+
+	Latency benchmark of the PN532_I2C library against the simulated
+	PN532, in virtual time. One line per scenario:
+
+	    <name> <result> <ms> <I2C bytes> <I2C reads>
+
+	Figures are the mean of BENCHMARK_CYCLES cycles, each on a freshly
+	initialised reader (init is measured on its own). "make check"
+	compares them with baseline.txt.
+
+	A "decode" line tells whether the purse and history read from the
+	simulated card decode to the values it holds, and a "short_wire" line
+	whether a purse read on a core with a 32 byte Wire buffer fails at
+	once with PN532_ERROR_OVERFLOW. A "mux" line tells whether readers
+	behind I2C multiplexers open their own channel and close the one the
+	previous reader left open. The program exits with 1 if one fails.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "PN532_I2C.h"
+#include "pn532_sim.h"
+
+#include <stdio.h>
+
+// Cycles measured per scenario
+#define BENCHMARK_CYCLES                    (5)
+
+// Time a checkForEZLink_Transparent() cycle is given, ms
+#define BENCHMARK_TRANSPARENT_TIMEOUT       (5000)
+
+// Scenario set up
+#define BENCHMARK_IRQ_PIN                   (0x01) // IRQ pin polled
+#define BENCHMARK_IRQ_INTERRUPT             (0x02) // IRQ captured by an interrupt
+#define BENCHMARK_NO_IRQ                    (0x04) // PN532_NO_IRQ
+#define BENCHMARK_FAST_POLL                 (0x08) // PN532_RF_PRESET_FAST_POLL
+#define BENCHMARK_LEARN_FAST                (0x10) // Timeouts learned on a fast card first
+
+// Reads that teach the timeouts a fast card, with BENCHMARK_LEARN_FAST
+#define BENCHMARK_LEARN_CYCLES              (5)
+
+// Call measured by a scenario, one cycle
+typedef bool (*BenchmarkCall)(PN532_I2C & nfc);
+
+static PN532_Purse purse;
+
+static bool callInit(PN532_I2C & nfc) {
+	return nfc.init();
+}
+
+static bool callCheck(PN532_I2C & nfc) {
+	return nfc.checkForEZLink(&purse);
+}
+
+static bool callTransparent(PN532_I2C & nfc) {
+	uint32_t start = millis();
+
+	// A cycle ends when the state machine has walked through search,
+	// read and release
+	while (millis() - start < BENCHMARK_TRANSPARENT_TIMEOUT) {
+		if (nfc.checkForEZLink_Transparent(&purse)) return true;
+		delayMicroseconds(20);
+	}
+	return false;
+}
+
+static bool callWatch(PN532_I2C & nfc) {
+	// The untimed first cycle reads the card, the measured one finds it
+	// resting
+	return nfc.watchEZLink(&purse) == PN532_CARD_NONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs one scenario and prints its line
+
+    @param  name      Scenario name
+    @param  setup     BENCHMARK_* flags
+    @param  card      A card is on the reader
+    @param  card_us   Extra time the card takes per APDU (from the
+                      measured cycle on, with BENCHMARK_LEARN_FAST)
+    @param  call      Call measured
+*/
+/**************************************************************************/
+static void scenario(const char * name, uint8_t setup, bool card, uint32_t card_us, BenchmarkCall call) {
+	uint64_t total_us = 0;
+	uint32_t bytes = 0, reads = 0, start_reads;
+	uint64_t start;
+	bool ok = true;
+
+	for (uint8_t i=0; i<BENCHMARK_CYCLES; i++) {
+		PN532_I2C nfc((setup & BENCHMARK_NO_IRQ) ? PN532_NO_IRQ : PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+
+		pn532_sim_powercycle();
+		pn532_sim_card(card);
+		pn532_sim_card_delay((setup & BENCHMARK_LEARN_FAST) ? 0 : card_us);
+
+		if (call != callInit) {
+			if (setup & BENCHMARK_IRQ_INTERRUPT) nfc.useIRQInterrupt();
+			if (!nfc.init()) ok = false;
+			if (setup & BENCHMARK_FAST_POLL) nfc.applyRFPreset(PN532_RF_PRESET_FAST_POLL);
+			// Untimed first cycle: the learned timeouts settle
+			call(nfc);
+			if (setup & BENCHMARK_LEARN_FAST) {
+				for (uint8_t j=0; j<BENCHMARK_LEARN_CYCLES; j++) call(nfc);
+				pn532_sim_card_delay(card_us);
+			}
+		}
+
+		nfc.resetBusBytes();
+		start_reads = pn532_sim_reads();
+		start = pn532_sim_now();
+		if (!call(nfc)) ok = false;
+		total_us += pn532_sim_now() - start;
+		bytes += nfc.getBusBytes();
+		reads += pn532_sim_reads() - start_reads;
+		
+		if (setup & BENCHMARK_IRQ_INTERRUPT) nfc.useIRQInterrupt(false);
+	}
+
+	printf("%s %s %.2f %lu %lu\n", name, ok ? "ok" : "fail",
+		total_us / 1000.0 / BENCHMARK_CYCLES,
+		(unsigned long)(bytes / BENCHMARK_CYCLES), (unsigned long)(reads / BENCHMARK_CYCLES));
+}
+
+// Decoding checks, see decode()
+#define BENCHMARK_HISTORY                   (2)
+
+/**************************************************************************/
+/*!
+    @brief  Checks one decoded field, printing it to stderr if wrong
+
+    @returns  true if it has the expected value
+*/
+/**************************************************************************/
+static bool expect(const char * field, long value, long expected) {
+	if (value == expected) return true;
+	fprintf(stderr, "decode: %s is %ld, expected %ld\n", field, value, expected);
+	return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads the purse and BENCHMARK_HISTORY records of the simulated
+            card and checks them against what pn532_sim.cpp holds, then
+            prints the "decode" line
+
+    @returns  true if every field decoded as expected
+*/
+/**************************************************************************/
+static bool decode(void) {
+	PN532_I2C nfc(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+	PN532_PurseTransaction history[BENCHMARK_HISTORY];
+	uint8_t found = 0;
+	bool ok;
+
+	pn532_sim_powercycle();
+	pn532_sim_card(true);
+	pn532_sim_card_delay(0);
+	memset(&purse, 0, sizeof(purse));
+	memset(history, 0, sizeof(history));
+
+	ok = nfc.init() && nfc.checkForEZLink(&purse, history, BENCHMARK_HISTORY, &found);
+	if (!ok) fprintf(stderr, "decode: no card read, error %d\n", nfc.getLastError());
+
+	// Purse: enabled, balance -5.00, auto-load 10.00, last transaction
+	// -2.50
+	ok = expect("status", purse.status & PN532_PURSE_STATUS_ENABLED, PN532_PURSE_STATUS_ENABLED) && ok;
+	ok = expect("balance", purse.balance, -500) && ok;
+	ok = expect("autoload", purse.autoload, 1000) && ok;
+	ok = expect("can[0]", purse.can[0], 0x10) && ok;
+	ok = expect("csn[7]", purse.csn[7], 0x27) && ok;
+	ok = expect("expiry", purse.expiry, 0x2000) && ok;
+	ok = expect("last.type", purse.last.type, 0x31) && ok;
+	ok = expect("last.amount", purse.last.amount, -250) && ok;
+
+	// History: -1.00 bus fares, user data "TEST" and the record number
+	ok = expect("found", found, BENCHMARK_HISTORY) && ok;
+	for (uint8_t i=0; i<found && i<BENCHMARK_HISTORY; i++) {
+		ok = expect("history.type", history[i].type, 0x30) && ok;
+		ok = expect("history.amount", history[i].amount, -100) && ok;
+		ok = expect("history.datetime", history[i].datetime, 1) && ok;
+		ok = expect("history.user", memcmp(history[i].user, "TEST", 4), 0) && ok;
+	}
+
+	printf("decode %s\n", ok ? "ok" : "fail");
+	return ok;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads the purse through a 32 byte Wire buffer, as a core whose
+            buffer is smaller than PN532_I2C_READ_MAX tells, and prints
+            the "short_wire" line
+
+    @returns  true if the read failed with PN532_ERROR_OVERFLOW without
+              waiting for a resend
+*/
+/**************************************************************************/
+static bool shortWire(void) {
+	PN532_I2C nfc(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+	uint64_t start, full_us;
+	bool ok;
+
+	pn532_sim_powercycle();
+	pn532_sim_card(true);
+	pn532_sim_card_delay(0);
+
+	// A read that fits sets the time to beat
+	ok = nfc.init();
+	start = pn532_sim_now();
+	ok = nfc.checkForEZLink(&purse) && ok;
+	full_us = pn532_sim_now() - start;
+
+	pn532_sim_wire_buffer(32);
+	start = pn532_sim_now();
+	ok = !nfc.checkForEZLink(&purse) && ok;
+	ok = expect("short_wire error", nfc.getLastError(), PN532_ERROR_OVERFLOW) && ok;
+	if (pn532_sim_now() - start >= full_us) {
+		fprintf(stderr, "short_wire: waited or retried\n");
+		ok = false;
+	}
+	pn532_sim_wire_buffer(0);
+
+	printf("short_wire %s\n", ok ? "ok" : "fail");
+	return ok;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Alternates between a reader behind channel 2 of the
+            multiplexer at 0x70, one behind channel 5 of the multiplexer
+            at 0x71 with no PN532 there, and one on the bus itself; prints
+            the "mux" line
+
+    @returns  true if each reader found only its own channel open
+*/
+/**************************************************************************/
+static bool mux(void) {
+	PN532_I2C nfc(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+	PN532_I2C other(PN532_NO_IRQ, PN532_SIM_PIN_NC);
+	PN532_I2C plain(PN532_NO_IRQ, PN532_SIM_PIN_NC);
+	bool ok;
+
+	pn532_sim_powercycle();
+	pn532_sim_card(true);
+	pn532_sim_mux(0x70, 2);
+	nfc.setMux(0x70, 2);
+	other.setMux(0x71, 5);
+
+	ok = nfc.init() && nfc.checkForEZLink(&purse);
+	ok = expect("mux 0x70 control", pn532_sim_mux_control(0x70), 0x04) && ok;
+
+	// Nothing answers behind the other channel: the PN532 must not
+	// answer for it either
+	ok = !other.init() && ok;
+	ok = expect("mux 0x70 control", pn532_sim_mux_control(0x70), 0x00) && ok;
+	ok = expect("mux 0x71 control", pn532_sim_mux_control(0x71), 0x20) && ok;
+
+	ok = nfc.checkForEZLink(&purse) && ok;
+	ok = expect("mux 0x70 control", pn532_sim_mux_control(0x70), 0x04) && ok;
+	ok = expect("mux 0x71 control", pn532_sim_mux_control(0x71), 0x00) && ok;
+
+	// Taken off the multiplexer, the PN532 is reached by a reader
+	// without one, which closes the channel left open
+	pn532_sim_mux(PN532_SIM_NO_MUX, 0);
+	ok = plain.init() && ok;
+	ok = expect("mux 0x70 control", pn532_sim_mux_control(0x70), 0x00) && ok;
+
+	printf("mux %s\n", ok ? "ok" : "fail");
+	return ok;
+}
+
+int main(void) {
+	bool ok;
+
+	printf("# PN532_I2C host benchmark: <name> <result> <ms> <bytes> <reads>\n");
+
+	scenario("init", BENCHMARK_IRQ_PIN, true, 0, callInit);
+	scenario("checkForEZLink", BENCHMARK_IRQ_PIN, true, 0, callCheck);
+	scenario("checkForEZLink_Transparent", BENCHMARK_IRQ_PIN, true, 0, callTransparent);
+	scenario("checkForEZLink/interrupt", BENCHMARK_IRQ_INTERRUPT, true, 0, callCheck);
+	scenario("checkForEZLink/no_irq", BENCHMARK_NO_IRQ, true, 0, callCheck);
+	scenario("checkForEZLink/slow_card", BENCHMARK_IRQ_PIN, true, 30000, callCheck);
+	scenario("checkForEZLink/slow_after_fast", BENCHMARK_IRQ_PIN | BENCHMARK_LEARN_FAST, true, 30000, callCheck);
+	scenario("checkForEZLink/empty_field", BENCHMARK_IRQ_PIN | BENCHMARK_FAST_POLL, false, 0, callCheck);
+	scenario("watchEZLink/resting", BENCHMARK_IRQ_PIN, true, 0, callWatch);
+	ok = decode();
+	ok = shortWire() && ok;
+	ok = mux() && ok;
+	return ok ? 0 : 1;
+}
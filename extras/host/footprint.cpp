@@ -0,0 +1,201 @@
+/**************************************************************************/
+/*!
+    @file     footprint.cpp
+    @author   teuteuguy
+	@license
+
+	Host side footprint report of the PN532_I2C library, the counterpart
+	of examples/Footprint, against the simulated PN532. One line per
+	figure:
+
+	    <kind> <name> <bytes>
+
+	"ram reader" is the static RAM of one PN532_I2C object and
+	"ram buffer" its receive buffer (inside it, or shared by all readers
+	with PN532_MINIMAL). Each "stack" line is the high-water mark of one
+	call, run on a painted stack of its own. "make footprint" adds the
+	"flash" lines: the code each API links in, from builds that call it
+	alone (FOOTPRINT_API).
+
+	Host figures are those of the host CPU: pointers and code are larger
+	than on an AVR. Use them to compare profiles and changes, and
+	examples/Footprint for the figures of the target MCU.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "PN532_I2C.h"
+#include "pn532_sim.h"
+
+#include <stdio.h>
+#include <ucontext.h>
+
+// API called besides init(), as in examples/Footprint: -1 not even
+// init(), 0 none, 1 checkForEZLink(), 2 checkForEZLink_Transparent(),
+// 3 watchEZLink(), 4 pollLowPower(), 5 readCard() with the EZLink handler.
+// FOOTPRINT_ALL measures the stack of each of them.
+#define FOOTPRINT_ALL                       (6)
+#ifndef FOOTPRINT_API
+	#define FOOTPRINT_API                   FOOTPRINT_ALL
+#endif
+
+// Stack each call runs on, and the value painted over it
+#define FOOTPRINT_STACK                     (65536)
+#define FOOTPRINT_PAINT                     (0xA5)
+
+// Time a checkForEZLink_Transparent() cycle is given, ms
+#define FOOTPRINT_TRANSPARENT_TIMEOUT       (5000)
+
+#define FOOTPRINT_CALLS(api)                (FOOTPRINT_API == (api) || FOOTPRINT_API == FOOTPRINT_ALL)
+
+// Call measured, one cycle
+typedef bool (*FootprintCall)(PN532_I2C & nfc);
+
+#if FOOTPRINT_API > 0
+static PN532_Purse purse;
+#endif
+
+#if FOOTPRINT_API >= 0
+static bool callInit(PN532_I2C & nfc) {
+	return nfc.init();
+}
+
+#if FOOTPRINT_CALLS(1)
+static bool callCheck(PN532_I2C & nfc) {
+	return nfc.checkForEZLink(&purse);
+}
+#endif
+
+#if FOOTPRINT_CALLS(2)
+static bool callTransparent(PN532_I2C & nfc) {
+	uint32_t start = millis();
+
+	while (millis() - start < FOOTPRINT_TRANSPARENT_TIMEOUT) {
+		if (nfc.checkForEZLink_Transparent(&purse)) return true;
+		delayMicroseconds(20);
+	}
+	return false;
+}
+#endif
+
+#if FOOTPRINT_CALLS(3)
+static bool callWatch(PN532_I2C & nfc) {
+	return nfc.watchEZLink(&purse) == PN532_CARD_NEW;
+}
+#endif
+
+#if FOOTPRINT_CALLS(4)
+static bool callLowPower(PN532_I2C & nfc) {
+	return nfc.pollLowPower(&purse) == PN532_CARD_NEW;
+}
+#endif
+
+#if FOOTPRINT_CALLS(5)
+static bool callReadCard(PN532_I2C & nfc) {
+	uint32_t start = millis();
+
+	nfc.addCardHandler(PN532_TARGET_ISO14443_4B, PN532_I2C::readEZLinkCard, &purse);
+	while (millis() - start < 2000) {
+		if (nfc.readCard() > 0) return true;
+	}
+	return false;
+}
+#endif
+
+static uint8_t stack[FOOTPRINT_STACK];
+static ucontext_t caller, callee;
+static PN532_I2C * reader;
+static FootprintCall measured;
+static bool result;
+
+static void run(void) {
+	result = measured(*reader);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs a call on the painted stack
+
+    @param  call      Call measured
+
+    @returns  The stack high-water mark of the call, bytes
+*/
+/**************************************************************************/
+static uint32_t stackUsed(FootprintCall call) {
+	uint32_t i = 0;
+
+	memset(stack, FOOTPRINT_PAINT, sizeof(stack));
+	measured = call;
+	getcontext(&callee);
+	callee.uc_stack.ss_sp = stack;
+	callee.uc_stack.ss_size = sizeof(stack);
+	callee.uc_link = &caller;
+	makecontext(&callee, run, 0);
+	swapcontext(&caller, &callee);
+
+	// The stack grows down from the end of the array
+	while (i < sizeof(stack) && stack[i] == FOOTPRINT_PAINT) i++;
+	return sizeof(stack) - i;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Measures one API on a freshly initialised reader and prints
+            its line
+
+    @param  name      API name
+    @param  call      Call measured
+*/
+/**************************************************************************/
+static void report(const char * name, FootprintCall call) {
+	uint32_t used;
+
+	pn532_sim_powercycle();
+	pn532_sim_card(true);
+	reader = new PN532_I2C(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+	if (call != callInit) stackUsed(callInit);
+
+	used = stackUsed(call);
+	printf("stack %s %lu%s\n", name, (unsigned long)used, result ? "" : " # failed");
+	delete reader;
+}
+#endif
+
+int main(void) {
+	printf("# PN532_I2C host footprint%s: <kind> <name> <bytes>\n",
+		#ifdef PN532_MINIMAL
+			" (PN532_MINIMAL)"
+		#else
+			""
+		#endif
+		);
+	printf("ram reader %lu\n", (unsigned long)sizeof(PN532_I2C));
+	printf("ram buffer %lu\n", (unsigned long)PN532_PACKBUFFSIZ);
+
+	#if FOOTPRINT_API >= 0
+		// Untimed first run: one-time set up of the host C library stays
+		// out of the figures
+		pn532_sim_powercycle();
+		reader = new PN532_I2C(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+		stackUsed(callInit);
+		delete reader;
+
+		report("init", callInit);
+	#endif
+	#if FOOTPRINT_CALLS(1)
+		report("checkForEZLink", callCheck);
+	#endif
+	#if FOOTPRINT_CALLS(2)
+		report("checkForEZLink_Transparent", callTransparent);
+	#endif
+	#if FOOTPRINT_CALLS(3)
+		report("watchEZLink", callWatch);
+	#endif
+	#if FOOTPRINT_CALLS(4)
+		report("pollLowPower", callLowPower);
+	#endif
+	#if FOOTPRINT_CALLS(5)
+		report("readCard", callReadCard);
+	#endif
+	return 0;
+}
@@ -0,0 +1,394 @@
+/**************************************************************************/
+/*!
+    @file     mock_test.cpp
+    @author   teuteuguy
+	@license
+
+	Tests of the frame and command logic of the PN532_I2C library over
+	the mock transport (mock_transport.h) and the simulated PN532. One
+	line per test:
+
+	    <name> <result>
+
+	The program exits with 1 if a test failed. "make check" runs it, and
+	runs it again built with PN532_MINIMAL.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "PN532_I2C.h"
+#include "pn532_sim.h"
+
+#include <stdio.h>
+
+// Test, on an initialised reader
+typedef bool (*MockTest)(PN532_I2C & nfc);
+
+static PN532_Purse purse;
+
+static bool testRead(PN532_I2C & nfc) {
+	return nfc.checkForEZLink(&purse) && purse.balance == -500;
+}
+
+static bool testBusy(PN532_I2C & nfc) {
+	// The PN532 stays busy for a few status reads after the ACK is due
+	pn532_mock_busy(5);
+	return nfc.checkForEZLink(&purse) && purse.balance == -500;
+}
+
+static bool testCorrupt(PN532_I2C & nfc) {
+	// One damaged response frame fails with a DCS error, without backoff
+	// of the learned timeout; the read after it goes through
+	pn532_mock_corrupt(1);
+	if (nfc.checkForEZLink(&purse)) return false;
+	if (nfc.getLastError() != PN532_ERROR_DCS) return false;
+	return nfc.checkForEZLink(&purse) && purse.balance == -500;
+}
+
+static bool testListTargets(PN532_I2C & nfc) {
+	PN532_Target targets[2];
+	uint8_t found;
+
+	// Two type B cards in the field, both listed by one search, unless
+	// the profile lists one target only (PN532_MINIMAL)
+	pn532_sim_second_card(true);
+	found = nfc.listTargets(PN532_TARGET_GENERIC_106B, targets, 2);
+	if (found != ((PN532_MAX_TARGETS < 2) ? 1 : 2)) return false;
+	if (targets[0].tg != 1 || targets[0].id[1] != 0x01) return false;
+	if (found == 2 && (targets[1].tg != 2 || targets[1].id[1] != 0x05)) return false;
+	return nfc.releaseTarget(0);
+}
+
+static bool testFeliCa(PN532_I2C & nfc) {
+	PN532_Target target;
+
+	// The simulated card only answers the POLLING payload of any system
+	// code; the IDm is the target identifier
+	pn532_sim_card(false);
+	pn532_sim_felica_card(true);
+	if (nfc.listTargets(PN532_TARGET_FELICA_212, &target, 1) != 1) return false;
+	return target.type == PN532_TARGET_FELICA_212 && target.idlen == 8 &&
+		target.id[0] == 0x01 && target.id[7] == 0x88;
+}
+
+static bool testReadCard(PN532_I2C & nfc) {
+	uint64_t start;
+	uint8_t read = 0;
+
+	nfc.addCardHandler(PN532_TARGET_ISO14443_4B, PN532_I2C::readEZLinkCard, &purse);
+
+	// Starting the InAutoPoll costs its write, checking on it a status
+	// read: neither waits for the card
+	for (uint8_t i=0; i<2; i++) {
+		start = pn532_sim_now();
+		read = nfc.readCard();
+		if (read > 0) return false;
+		if (pn532_sim_now() - start > 2000) return false;
+	}
+
+	start = pn532_sim_now();
+	while (read == 0 && pn532_sim_now() - start < 2000000) read = nfc.readCard();
+	return read == 1 && purse.balance == -500;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Takes the next queued event and checks its type
+
+    @returns  true if there was one, of that type
+*/
+/**************************************************************************/
+static bool expectEvent(PN532_I2C & nfc, uint8_t type) {
+	PN532_Event event;
+
+	if (!nfc.getEvent(&event)) return false;
+	if (event.type != type) return false;
+	if (type == PN532_EVENT_READ_COMPLETE && event.balance != -500) return false;
+	return true;
+}
+
+static bool noEvent(PN532_I2C & nfc) {
+	PN532_Event event;
+
+	return !nfc.getEvent(&event);
+}
+
+static bool testWatchEvents(PN532_I2C & nfc) {
+	uint64_t start;
+
+	nfc.applyRFPreset(PN532_RF_PRESET_FAST_POLL);
+	if (nfc.watchEZLink(&purse) != PN532_CARD_NEW) return false;
+	if (!expectEvent(nfc, PN532_EVENT_CARD_ARRIVED)) return false;
+	if (!expectEvent(nfc, PN532_EVENT_READ_COMPLETE)) return false;
+
+	// A resting card raises no event, a lifted one its removal after the
+	// hold time
+	if (nfc.watchEZLink(&purse) != PN532_CARD_NONE || !noEvent(nfc)) return false;
+	pn532_sim_card(false);
+	start = pn532_sim_now();
+	while (nfc.watchEZLink(&purse) != PN532_CARD_GONE) {
+		if (pn532_sim_now() - start > 2000000) return false;
+	}
+	return expectEvent(nfc, PN532_EVENT_CARD_REMOVED) && noEvent(nfc);
+}
+
+static bool testCardSwap(PN532_I2C & nfc) {
+	PN532_Event event;
+
+	nfc.applyRFPreset(PN532_RF_PRESET_FAST_POLL);
+	if (nfc.watchEZLink(&purse) != PN532_CARD_NEW) return false;
+	if (!expectEvent(nfc, PN532_EVENT_CARD_ARRIVED)) return false;
+	if (!expectEvent(nfc, PN532_EVENT_READ_COMPLETE)) return false;
+
+	// Another card in its place between two calls: the old one is gone
+	// first, the new one arrives on the next call
+	pn532_sim_card_swap(0x40);
+	if (nfc.watchEZLink(&purse) != PN532_CARD_GONE) return false;
+	if (!nfc.getEvent(&event) || event.type != PN532_EVENT_CARD_REMOVED || event.can[0] != PN532_SIM_CAN) return false;
+	if (!noEvent(nfc)) return false;
+
+	if (nfc.watchEZLink(&purse) != PN532_CARD_NEW || purse.can[0] != 0x40) return false;
+	if (!nfc.getEvent(&event) || event.type != PN532_EVENT_CARD_ARRIVED || event.can[0] != 0x40) return false;
+	return expectEvent(nfc, PN532_EVENT_READ_COMPLETE) && noEvent(nfc);
+}
+
+static bool testLowPowerEvents(PN532_I2C & nfc) {
+	uint64_t start = pn532_sim_now();
+
+	nfc.applyRFPreset(PN532_RF_PRESET_FAST_POLL);
+	while (nfc.pollLowPower(&purse) != PN532_CARD_NEW) {
+		if (pn532_sim_now() - start > 2000000) return false;
+		delay(10);
+	}
+	return expectEvent(nfc, PN532_EVENT_CARD_ARRIVED) &&
+		expectEvent(nfc, PN532_EVENT_READ_COMPLETE);
+}
+
+static bool testReadRelease(PN532_I2C & nfc) {
+	// A card that cannot be read is not left listed
+	pn532_mock_corrupt(1 + PN532_EZLINK_RETRIES, PN532_RESPONSE_INDATAEXCHANGE);
+	if (nfc.checkForEZLink(&purse)) return false;
+	return nfc.getLastError() == PN532_ERROR_DCS && !pn532_sim_listed();
+}
+
+static bool testTransparentRelease(PN532_I2C & nfc) {
+	PN532_Event event;
+	uint64_t start = pn532_sim_now();
+
+	// Every read of the card (one and PN532_EZLINK_RETRIES) comes back
+	// damaged: the card is released before the read error is reported
+	pn532_mock_corrupt(1 + PN532_EZLINK_RETRIES, PN532_RESPONSE_INDATAEXCHANGE);
+	while (!nfc.getEvent(&event)) {
+		if (nfc.checkForEZLink_Transparent(&purse)) return false;
+		if (pn532_sim_now() - start > 2000000) return false;
+		delayMicroseconds(20);
+	}
+	return event.type == PN532_EVENT_ERROR && event.status == PN532_ERROR_DCS &&
+		nfc.getLastError() == PN532_ERROR_DCS && !pn532_sim_listed();
+}
+
+static bool testLegacyCalls(PN532_I2C & nfc) {
+	uint8_t can[8], expected[8] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17 };
+	float balance = 0;
+	uint64_t start = pn532_sim_now();
+
+	// The former CAN and float balance calls, kept for old sketches
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+	if (!nfc.checkForEZLink(can, &balance)) return false;
+	if (memcmp(can, expected, 8) != 0 || balance != -5.0f) return false;
+
+	memset(can, 0, sizeof(can));
+	balance = 0;
+	while (!nfc.checkForEZLink_Transparent(can, &balance)) {
+		if (pn532_sim_now() - start > 2000000) return false;
+		delayMicroseconds(20);
+	}
+	#pragma GCC diagnostic pop
+	return memcmp(can, expected, 8) == 0 && balance == -5.0f;
+}
+
+static bool testNoCard(PN532_I2C & nfc) {
+	pn532_sim_card(false);
+	return !nfc.checkForEZLink(&purse);
+}
+
+#ifdef PN532_MINIMAL
+static bool testSharedBuffer(PN532_I2C & nfc) {
+	PN532_I2C second(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+
+	// nfc holds the shared buffer: a second reader on it is refused
+	// before it touches the PN532, and nfc goes on reading
+	if (second.init() || second.getLastError() != PN532_ERROR_SHARED) return false;
+	return nfc.checkForEZLink(&purse) && purse.balance == -500;
+}
+#endif
+
+static bool testSmallBuffer(PN532_I2C & nfc) {
+	uint8_t tiny[PN532_I2C_WIRE_BUFSIZ - 1], small[PN532_I2C_WIRE_BUFSIZ];
+	PN532_I2C tinyReader(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET, PN532_TRANSPORT_ADDRESS, tiny, sizeof(tiny));
+	PN532_I2C smallReader(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET, PN532_TRANSPORT_ADDRESS, small, sizeof(small));
+
+	// A buffer below one bus transfer is refused, one below the purse
+	// answer fails the read
+	(void)nfc;
+	if (tinyReader.init() || tinyReader.getLastError() != PN532_ERROR_OVERFLOW) return false;
+	if (!smallReader.init()) return false;
+	return !smallReader.checkForEZLink(&purse) && smallReader.getLastError() == PN532_ERROR_OVERFLOW;
+}
+
+static bool testAutoPollTimeout(PN532_I2C & nfc) {
+	uint8_t types[15];
+	PN532_Target target;
+	uint64_t start, elapsed;
+	uint8_t found, result;
+
+	// 254 rounds of 15 types outlast any 16 bit deadline: it is clamped
+	// to 65534 ms, neither wrapped nor taken as PN532_TIMEOUT_ADAPTIVE
+	memset(types, PN532_TARGET_ISO14443_4B, sizeof(types));
+	pn532_sim_card(false);
+	start = pn532_sim_now();
+	if (!nfc.startAutoPoll(types, sizeof(types), 0xFE, 0xFF)) return false;
+	do {
+		delay(10);
+		result = nfc.pollAutoPoll(&target, 1, &found);
+	} while (result == PN532_ASYNC_BUSY);
+	elapsed = (pn532_sim_now() - start) / 1000;
+	if (result != PN532_ASYNC_ERROR || nfc.getLastError() != PN532_ERROR_TIMEOUT) return false;
+	return elapsed >= PN532_TIMEOUT_ADAPTIVE - 1 && elapsed < PN532_TIMEOUT_ADAPTIVE + 100;
+}
+
+static bool testTimeoutBackoff(PN532_I2C & nfc) {
+	const uint8_t apdu[] = { 0x90, 0x32, 0x03, 0x00, 0x00, 0x00 };
+	PN532_Target target;
+	uint16_t learned, backoff;
+
+	// Purse reads at the RF delay bring InDataExchange to its floor
+	for (uint8_t i=0; i<4; i++) {
+		if (!nfc.checkForEZLink(&purse)) return false;
+	}
+	learned = nfc.getTimeout(PN532_COMMAND_INDATAEXCHANGE);
+	if (learned != PN532_TIMEOUT_FLOOR) return false;
+
+	// Each timeout of a card slower than the deadline doubles it, to the
+	// ms it is rounded to
+	pn532_sim_card_delay(100000);
+	if (nfc.listTargets(PN532_TARGET_GENERIC_106B, &target, 1) != 1) return false;
+	if (nfc.dataExchange(target.tg, apdu, sizeof(apdu)) != PN532_ERROR_TIMEOUT) return false;
+	backoff = nfc.getTimeout(PN532_COMMAND_INDATAEXCHANGE);
+	if (backoff < 2 * learned || backoff > 2 * learned + 1) return false;
+	if (nfc.dataExchange(target.tg, apdu, sizeof(apdu)) != PN532_ERROR_TIMEOUT) return false;
+	if (nfc.getTimeout(PN532_COMMAND_INDATAEXCHANGE) < 2 * backoff - 1) return false;
+
+	// A few good samples bring it back down to the floor
+	pn532_sim_card_delay(0);
+	for (uint8_t i=0; i<16 && nfc.getTimeout(PN532_COMMAND_INDATAEXCHANGE) > learned; i++) {
+		if (nfc.dataExchange(target.tg, apdu, sizeof(apdu)) != PN532_OK) return false;
+	}
+	if (nfc.getTimeout(PN532_COMMAND_INDATAEXCHANGE) != learned) return false;
+	return nfc.releaseTarget(0);
+}
+
+// Readers whose submitted command completed, in order
+static PN532_I2C * scheduled[2];
+static uint8_t nscheduled;
+
+static void scheduledDone(PN532_I2C * reader, uint8_t * frame, uint8_t framelen) {
+	(void)framelen;
+	if (frame && nscheduled < 2) scheduled[nscheduled++] = reader;
+}
+
+static bool testScheduler(PN532_I2C & nfc) {
+	uint8_t buffer[PN532_PACKBUFFSIZ], otherbuffer[PN532_PACKBUFFSIZ];
+	PN532_I2C first(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET, PN532_TRANSPORT_ADDRESS, buffer, sizeof(buffer));
+	PN532_I2C other(PN532_NO_IRQ, PN532_SIM_PIN_NC, PN532_SIM_SECOND_ADDRESS, otherbuffer, sizeof(otherbuffer));
+	PN532_I2C_Scheduler scheduler;
+	uint8_t list[] = { PN532_COMMAND_INLISTPASSIVETARGET, 0x01, 0x03, 0x00 };
+	uint8_t version[] = { PN532_COMMAND_GETFIRMWAREVERSION };
+
+	// The scheduled readers have buffers of their own, as PN532_MINIMAL
+	// asks: the one on the shared buffer is refused
+	#ifdef PN532_MINIMAL
+		if (scheduler.add(&nfc)) return false;
+	#else
+		(void)nfc;
+	#endif
+	if (!first.init() || !other.init()) return false;
+	if (!scheduler.add(&first) || !scheduler.add(&other)) return false;
+	nscheduled = 0;
+
+	// Steps alternate between the two readers while both wait; the
+	// quick command completes while the card is still being listed
+	if (!first.submit(list, sizeof(list), scheduledDone)) return false;
+	if (!other.submit(version, sizeof(version), scheduledDone)) return false;
+	if (scheduler.run() != &first || scheduler.run() != &other || scheduler.run() != &first) return false;
+	for (uint16_t i=0; i<10000 && scheduler.run() != 0; i++) delayMicroseconds(20);
+
+	if (nscheduled != 2 || scheduled[0] != &other || scheduled[1] != &first) return false;
+	return first.releaseTarget(0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs one test on a freshly initialised reader and prints its
+            line. Every frame the library wrote must be well formed.
+
+    @returns  true if the test passed
+*/
+/**************************************************************************/
+static bool test(const char * name, MockTest call) {
+	PN532_I2C nfc(PN532_SIM_PIN_IRQ, PN532_SIM_PIN_RESET);
+	uint32_t bad;
+	bool ok;
+
+	pn532_sim_powercycle();
+	pn532_sim_card(true);
+	pn532_sim_card_swap(PN532_SIM_CAN);
+	pn532_sim_second_card(false);
+	pn532_sim_felica_card(false);
+	pn532_sim_card_delay(0);
+	pn532_mock_busy(0);
+	pn532_mock_corrupt(0);
+	memset(&purse, 0, sizeof(purse));
+
+	bad = pn532_mock_badframes();
+	ok = nfc.init() && call(nfc);
+	if (pn532_mock_badframes() != bad) {
+		fprintf(stderr, "%s: %lu malformed frames written\n", name, (unsigned long)(pn532_mock_badframes() - bad));
+		ok = false;
+	}
+	if (!ok) fprintf(stderr, "%s: last error %d\n", name, nfc.getLastError());
+
+	printf("%s %s\n", name, ok ? "ok" : "fail");
+	return ok;
+}
+
+int main(void) {
+	bool ok = true;
+
+	printf("# PN532_I2C mock transport tests: <name> <result>\n");
+
+	ok = test("read", testRead) && ok;
+	ok = test("busy", testBusy) && ok;
+	ok = test("corrupt", testCorrupt) && ok;
+	ok = test("list_targets", testListTargets) && ok;
+	ok = test("felica", testFeliCa) && ok;
+	ok = test("read_card", testReadCard) && ok;
+	ok = test("watch_events", testWatchEvents) && ok;
+	ok = test("card_swap", testCardSwap) && ok;
+	ok = test("low_power_events", testLowPowerEvents) && ok;
+	ok = test("read_release", testReadRelease) && ok;
+	ok = test("transparent_release", testTransparentRelease) && ok;
+	ok = test("legacy_calls", testLegacyCalls) && ok;
+	ok = test("no_card", testNoCard) && ok;
+	ok = test("small_buffer", testSmallBuffer) && ok;
+	#ifdef PN532_MINIMAL
+		ok = test("shared_buffer", testSharedBuffer) && ok;
+	#endif
+	ok = test("scheduler", testScheduler) && ok;
+	ok = test("autopoll_timeout", testAutoPollTimeout) && ok;
+	ok = test("timeout_backoff", testTimeoutBackoff) && ok;
+
+	printf("# %lu frames written\n", (unsigned long)pn532_mock_frames());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/**************************************************************************/
+/*!
+    @file     mock_transport.cpp
+    @author   teuteuguy
+	@license
+
+	Mock transport of the host tests, see mock_transport.h.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "PN532_Transport.h"
+
+static uint8_t pn532_mock_busy_reads = 0;
+static uint8_t pn532_mock_corrupt_frames = 0;
+static uint8_t pn532_mock_corrupt_response = 0;
+static uint32_t pn532_mock_written = 0;
+static uint32_t pn532_mock_bad = 0;
+
+void pn532_mock_busy(uint8_t reads) {
+	pn532_mock_busy_reads = reads;
+}
+
+void pn532_mock_corrupt(uint8_t frames, uint8_t response) {
+	pn532_mock_corrupt_frames = frames;
+	pn532_mock_corrupt_response = response;
+}
+
+uint32_t pn532_mock_frames(void) {
+	return pn532_mock_written;
+}
+
+uint32_t pn532_mock_badframes(void) {
+	return pn532_mock_bad;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Checks a frame written by the library: ACK, NACK, or normal
+            information frame with matching length and data checksums
+
+    @returns  true if the frame is well formed
+*/
+/**************************************************************************/
+static bool pn532_mock_wellformed(const uint8_t* buff, uint8_t n) {
+	uint8_t sum = 0;
+
+	if (n < 6 || buff[0] != 0x00 || buff[1] != 0x00 || buff[2] != 0xFF) return false;
+	if (buff[3] == 0x00 && buff[4] == 0xFF) return n == 6; // ACK
+	if (buff[3] == 0xFF && buff[4] == 0x00) return n == 6; // NACK
+	if ((uint8_t)(buff[3] + buff[4]) != 0 || n != buff[3] + 7) return false;
+	for (uint8_t i=0; i<buff[3] + 1; i++) sum += buff[5 + i];
+	return sum == 0 && buff[n - 1] == 0x00;
+}
+
+PN532_MockTransport::PN532_MockTransport(uint8_t address) {
+	_address = address;
+	_bytes = 0;
+}
+
+void PN532_MockTransport::begin(uint32_t clock) {
+	Wire.begin();
+	Wire.setClock(clock);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Checks the frame, then writes it to the simulated PN532
+*/
+/**************************************************************************/
+void PN532_MockTransport::write(const uint8_t* buff, uint8_t n) {
+	pn532_mock_written++;
+	if (!pn532_mock_wellformed(buff, n)) pn532_mock_bad++;
+
+	Wire.beginTransmission(_address);
+	Wire.write(buff, n);
+	Wire.endTransmission();
+	_bytes += n;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads the status byte and n bytes from the simulated PN532,
+            and applies the faults asked for: a read is answered busy
+            without reaching the PN532, which keeps its frame, or the DCS
+            of a whole response frame is flipped
+
+    @returns  false if the PN532 was, or is said to be, not ready
+*/
+/**************************************************************************/
+bool PN532_MockTransport::read(uint8_t* buff, uint8_t n) {
+	uint8_t status;
+	uint8_t len;
+
+	_bytes += n + 1;
+	if (pn532_mock_busy_reads > 0) {
+		pn532_mock_busy_reads--;
+		return false;
+	}
+
+	if (Wire.requestFrom(_address, (uint8_t)(n+1)) != n + 1) {
+		while (Wire.available()) Wire.read();
+		return false;
+	}
+	status = Wire.read();
+	for (uint8_t i=0; i<n; i++) {
+		buff[i] = Wire.read();
+	}
+	if (!(status & PN532_I2C_READY)) return false;
+
+	// A response frame read whole, not an ACK or a header: LEN, LCS,
+	// TFI, data and DCS are in
+	len = (n >= 5) ? buff[3] : 0;
+	if (pn532_mock_corrupt_frames > 0 && len > 0 && len != 0xFF && n >= len + 6 &&
+		(pn532_mock_corrupt_response == 0 || buff[6] == pn532_mock_corrupt_response)) {
+		pn532_mock_corrupt_frames--;
+		buff[5 + len] ^= 0x5A;
+	}
+	return true;
+}
+
+void PN532_MockTransport::wake(void) {
+	Wire.beginTransmission(_address);
+	Wire.endTransmission();
+}
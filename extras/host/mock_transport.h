@@ -0,0 +1,51 @@
+/**************************************************************************/
+/*!
+    @file     mock_transport.h
+    @author   teuteuguy
+	@license
+
+	Mock transport of the host tests, plugged in with
+	PN532_TRANSPORT_CUSTOM. It moves bytes to and from the simulated
+	PN532 of pn532_sim.cpp as the I2C transport does, and in between
+	checks every frame the library writes and injects faults in what it
+	reads: PN532 busy, corrupted response frames.
+*/
+/**************************************************************************/
+
+#ifndef PN532_Mock_Transport_h
+#define PN532_Mock_Transport_h
+
+#include "Arduino.h"
+
+#define PN532_TRANSPORT_ADDRESS             PN532_I2C_ADDRESS
+#define PN532_TRANSPORT_CLOCK               PN532_I2C_CLOCK_STANDARD
+#define PN532_TRANSPORT_WAKEUP              PN532_WAKEUP_I2C
+#define PN532_TRANSPORT_READ_MAX            (0xFF)
+
+class PN532_MockTransport {
+	public:
+					PN532_MockTransport(uint8_t address);
+		void		begin(uint32_t clock);
+		void		write(const uint8_t* buff, uint8_t n);
+		bool		read(uint8_t* buff, uint8_t n);
+		void		wake(void);
+		uint32_t	getBytes(void) { return _bytes; }
+		void		resetBytes(void) { _bytes = 0; }
+
+	private:
+		uint8_t		_address;
+		uint32_t	_bytes;
+};
+
+typedef PN532_MockTransport PN532_TransportType;
+
+// Faults injected in the next reads
+void		pn532_mock_busy(uint8_t reads); // Reads answered "busy"
+// Response frames read with a bad DCS: any, or those of one response code
+void		pn532_mock_corrupt(uint8_t frames, uint8_t response = 0);
+
+// Frames written, and those with a bad length or checksum
+uint32_t	pn532_mock_frames(void);
+uint32_t	pn532_mock_badframes(void);
+
+#endif
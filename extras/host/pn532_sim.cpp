@@ -0,0 +1,640 @@
+/**************************************************************************/
+/*!
+    @file     pn532_sim.cpp
+    @author   teuteuguy
+	@license
+
+	Virtual clock, Arduino core functions, Wire bus and simulated PN532
+	of the host build, see pn532_sim.h.
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "pn532_sim.h"
+
+#include <stdio.h>
+#include <vector>
+
+#define PN532_SIM_ADDRESS                   (0x24)
+#define PN532_SIM_CLOCK                     (100000UL)
+#define PN532_SIM_FOREVER                   (0xFF) // MxRtyPassiveActivation, PollNr
+#define PN532_SIM_MUX_FIRST                 (0x70) // Addresses a TCA9548A can take
+#define PN532_SIM_MUX_LAST                  (0x77)
+
+typedef std::vector<uint8_t> pn532_sim_bytes;
+
+// State of the simulated PN532
+struct PN532_SimChip {
+	pn532_sim_bytes	frame; // Sent by the next ready read
+	uint64_t		frame_at; // Time the frame becomes ready
+	bool			has_frame;
+	bool			frame_ack; // The frame is the ACK of the last command
+	pn532_sim_bytes	response; // Becomes the frame once the ACK is read
+	uint32_t		response_us;
+	bool			has_response;
+	pn532_sim_bytes	last; // Last response, sent again on NACK
+	bool			sleep_after; // PowerDown: asleep once the response is read
+	bool			asleep;
+	bool			in_reset;
+	uint64_t		awake_at; // Clock stretched until then (boot, wake up)
+	bool			listed; // The card is listed as target 1
+	uint8_t			retries; // MxRtyPassiveActivation
+};
+
+// The PN532 on the pins, and the one at PN532_SIM_SECOND_ADDRESS
+static PN532_SimChip pn532_sim_chips[2];
+
+static uint64_t pn532_sim_clock_us = 0;
+static uint32_t pn532_sim_bus = PN532_SIM_CLOCK;
+static uint32_t pn532_sim_nreads = 0;
+static uint32_t pn532_sim_nwrites = 0;
+static uint16_t pn532_sim_wire_size = 0;
+
+static bool pn532_sim_present = true;
+static uint8_t pn532_sim_can = PN532_SIM_CAN;
+static bool pn532_sim_second = false;
+static bool pn532_sim_felica = false;
+static uint8_t pn532_sim_mux_address = PN532_SIM_NO_MUX;
+static uint8_t pn532_sim_mux_channel = 0;
+static uint8_t pn532_sim_mux_controls[PN532_SIM_MUX_LAST - PN532_SIM_MUX_FIRST + 1];
+static uint32_t pn532_sim_processing_us = PN532_SIM_PROCESSING_US;
+static uint32_t pn532_sim_rf_us = PN532_SIM_RF_US;
+static uint32_t pn532_sim_card_us = 0;
+
+static bool pn532_sim_irq_low = false;
+static void (*pn532_sim_irq_handler)(void) = 0;
+
+static pn532_sim_bytes pn532_sim_tx;
+static uint8_t pn532_sim_txaddress;
+static pn532_sim_bytes pn532_sim_rx;
+static size_t pn532_sim_rxpos;
+
+TwoWire Wire;
+
+static void pn532_sim_start(void);
+static bool pn532_sim_started = (pn532_sim_start(), true);
+
+
+/**************************************************************************/
+/*!
+    @brief  Level of the PN532 IRQ line: low while a frame is ready
+*/
+/**************************************************************************/
+static bool pn532_sim_irq(void) {
+	PN532_SimChip * chip = &pn532_sim_chips[0];
+
+	return chip->has_frame && !chip->asleep && pn532_sim_clock_us >= chip->frame_at;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Moves the virtual clock on. An IRQ falling edge within the
+            step runs the attached interrupt handler at its own time.
+*/
+/**************************************************************************/
+static void pn532_sim_advance(uint64_t us) {
+	PN532_SimChip * chip = &pn532_sim_chips[0];
+	static bool in_handler = false;
+	uint64_t end = pn532_sim_clock_us + us;
+
+	// Time stands still in the interrupt handler
+	if (in_handler) return;
+
+	if (!pn532_sim_irq_low && chip->has_frame && chip->frame_at > pn532_sim_clock_us && chip->frame_at <= end) {
+		pn532_sim_clock_us = chip->frame_at;
+	} else {
+		pn532_sim_clock_us = end;
+	}
+	if (pn532_sim_irq() && !pn532_sim_irq_low) {
+		pn532_sim_irq_low = true;
+		if (pn532_sim_irq_handler) {
+			in_handler = true;
+			pn532_sim_irq_handler();
+			in_handler = false;
+		}
+	}
+	pn532_sim_irq_low = pn532_sim_irq();
+	pn532_sim_clock_us = end;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Bus time of an I2C transfer of n bytes plus the address
+*/
+/**************************************************************************/
+static uint64_t pn532_sim_bustime(size_t n) {
+	return (uint64_t)(n + 1) * 9 * 1000000 / pn532_sim_bus;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Builds a normal information frame around data
+*/
+/**************************************************************************/
+static pn532_sim_bytes pn532_sim_frame(const pn532_sim_bytes & data) {
+	pn532_sim_bytes frame;
+	uint8_t sum = 0;
+
+	frame.push_back(0x00);
+	frame.push_back(0x00);
+	frame.push_back(0xFF);
+	frame.push_back(data.size());
+	frame.push_back(0x100 - data.size());
+	for (size_t i=0; i<data.size(); i++) {
+		frame.push_back(data[i]);
+		sum += data[i];
+	}
+	frame.push_back(0x100 - sum);
+	frame.push_back(0x00);
+	return frame;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Answer of the CEPAS card to an APDU
+*/
+/**************************************************************************/
+static pn532_sim_bytes pn532_sim_cepas(const uint8_t * apdu, size_t len) {
+	pn532_sim_bytes answer;
+	uint8_t purse[95];
+
+	if (len < 6 || apdu[0] != 0x90 || apdu[1] != 0x32) {
+		// Instruction not supported
+		answer.push_back(0x6D);
+		answer.push_back(0x00);
+		return answer;
+	}
+
+	if (len >= 7 && apdu[4] == 0x01) {
+		// Read records: <first> <length>, every record a -1.00 bus fare
+		uint8_t count = (len >= 7) ? apdu[6] / 16 : 0;
+		for (uint8_t i=0; i<count; i++) {
+			const uint8_t record[16] = { 0x30, 0xFF, 0xFF, 0x9C, 0x00, 0x00, 0x00, 0x01,
+				'T', 'E', 'S', 'T', 0x00, 0x00, 0x00, (uint8_t)(apdu[5] + i) };
+			answer.insert(answer.end(), record, record + 16);
+		}
+	} else {
+		// Read purse: enabled, balance -5.00, auto load 10.00, last
+		// transaction -2.50
+		memset(purse, 0, sizeof(purse));
+		purse[0] = 0x01;
+		purse[1] = 0x01;
+		purse[2] = 0xFF; purse[3] = 0xFE; purse[4] = 0x0C;
+		purse[5] = 0x00; purse[6] = 0x03; purse[7] = 0xE8;
+		for (uint8_t i=0; i<8; i++) {
+			purse[8 + i] = pn532_sim_can + i; // CAN
+			purse[16 + i] = 0x20 + i; // CSN
+		}
+		purse[24] = 0x20; purse[25] = 0x00; // Expiry
+		purse[38] = 0x05;
+		purse[46] = 0x31; purse[47] = 0xFF; purse[48] = 0xFF; purse[49] = 0x06;
+		answer.insert(answer.end(), purse, purse + sizeof(purse));
+	}
+	answer.push_back(0x90);
+	answer.push_back(0x00);
+	return answer;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Runs a command
+
+    @param  chip      The PN532 addressed
+    @param  data      TFI, command code and parameters
+    @param  us        Receives the time the response takes
+
+    @returns  The response data, empty when the PN532 never answers
+              (search for ever in an empty field)
+*/
+/**************************************************************************/
+static pn532_sim_bytes pn532_sim_command(PN532_SimChip * chip, const pn532_sim_bytes & data, uint32_t * us) {
+	pn532_sim_bytes r;
+	uint8_t cmd = data[1];
+	size_t len = data.size();
+
+	*us = pn532_sim_processing_us;
+	r.push_back(0xD5);
+	r.push_back(cmd + 1);
+
+	switch (cmd) {
+		case 0x02: // GetFirmwareVersion: PN532 v1.6
+			r.push_back(0x32); r.push_back(0x01); r.push_back(0x06); r.push_back(0x07);
+			break;
+		case 0x14: // SAMConfiguration
+			break;
+		case 0x32: // RFConfiguration, MaxRetries is kept
+			if (len >= 6 && data[2] == 0x05) chip->retries = data[5];
+			break;
+		case 0x00: // Diagnose, NumTst 0x06 is the card presence test
+			if (len >= 3 && data[2] == 0x06) {
+				*us = pn532_sim_rf_us;
+				r.push_back((pn532_sim_present && chip->listed) ? 0x00 : 0x01);
+			} else {
+				r.push_back(0x00);
+			}
+			break;
+		case 0x16: // PowerDown
+			chip->sleep_after = true;
+			chip->listed = false;
+			r.push_back(0x00);
+			break;
+		case 0x4A: // InListPassiveTarget: the card is a CEPAS type B card
+			if (len >= 4 && data[3] == 0x03 && pn532_sim_present) {
+				const uint8_t target[] = { 0x01, 0x01, 0x50, 0x01, 0x02, 0x03, 0x04,
+					0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 };
+				const uint8_t second[] = { 0x02, 0x50, 0x05, 0x06, 0x07, 0x08,
+					0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 };
+				bool both = pn532_sim_second && data[2] >= 2;
+				*us = pn532_sim_rf_us;
+				r.push_back(both ? 2 : 1);
+				r.insert(r.end(), target + 1, target + sizeof(target));
+				if (both) r.insert(r.end(), second, second + sizeof(second));
+				chip->listed = true;
+			} else if (len >= 9 && (data[3] == 0x01 || data[3] == 0x02) && pn532_sim_felica &&
+				data[4] == 0x00 && data[5] == 0xFF && data[6] == 0xFF && data[7] == 0x01) {
+				// FeliCa POLLING of any system code, asking for it: IDm,
+				// PMm and the system code
+				const uint8_t target[] = { 0x01, 0x01, 0x14, 0x01,
+					0x01, 0x2E, 0x3D, 0x4C, 0x5B, 0x6A, 0x79, 0x88,
+					0x03, 0x01, 0x4B, 0x02, 0x4F, 0x49, 0x93, 0xFF, 0x88, 0xB4 };
+				*us = pn532_sim_rf_us;
+				r.insert(r.end(), target, target + sizeof(target));
+			} else if (chip->retries == PN532_SIM_FOREVER) {
+				r.clear();
+			} else {
+				*us = ((uint32_t)chip->retries + 1) * PN532_SIM_SEARCH_ROUND_US;
+				r.push_back(0x00);
+			}
+			break;
+		case 0x40: // InDataExchange
+			*us = pn532_sim_rf_us;
+			if (len < 3 || data[2] != 0x01 || !chip->listed || !pn532_sim_present) {
+				r.push_back(0x01); // Timeout
+			} else {
+				pn532_sim_bytes answer = pn532_sim_cepas(&data[3], len - 3);
+				*us += pn532_sim_card_us;
+				r.push_back(0x00);
+				r.insert(r.end(), answer.begin(), answer.end());
+			}
+			break;
+		case 0x52: // InRelease
+			chip->listed = false;
+			r.push_back(0x00);
+			break;
+		case 0x60: // InAutoPoll
+			if (pn532_sim_present) {
+				const uint8_t target[] = { 0x01, 0x23, 0x0F, 0x01, 0x50, 0x01, 0x02, 0x03, 0x04,
+					0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 };
+				*us = pn532_sim_rf_us;
+				r.insert(r.end(), target, target + sizeof(target));
+				chip->listed = true;
+			} else if (len < 5 || data[2] == PN532_SIM_FOREVER) {
+				r.clear();
+			} else {
+				*us = (uint32_t)data[2] * data[3] * 150 * (len - 4);
+				r.push_back(0x00);
+			}
+			break;
+		default: // Syntax error frame
+			r.clear();
+			r.push_back(0x7F);
+			break;
+	}
+	return r;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Handles a frame written to the PN532
+*/
+/**************************************************************************/
+static void pn532_sim_write(PN532_SimChip * chip, const pn532_sim_bytes & tx) {
+	static const uint8_t ack[] = { 0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00 };
+	static const uint8_t nack[] = { 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00 };
+	pn532_sim_bytes data;
+	uint8_t len, sum = 0;
+
+	if (tx.size() == sizeof(ack) && memcmp(&tx[0], ack, sizeof(ack)) == 0) {
+		// Abort the command in progress
+		chip->has_frame = false;
+		chip->has_response = false;
+		return;
+	}
+	if (tx.size() == sizeof(nack) && memcmp(&tx[0], nack, sizeof(nack)) == 0) {
+		if (chip->last.empty()) return;
+		chip->frame = chip->last;
+		chip->frame_ack = false;
+		chip->frame_at = pn532_sim_clock_us + PN532_SIM_ACK_US;
+		chip->has_frame = true;
+		return;
+	}
+
+	// Frames that do not check out are dropped, as by the chip
+	if (tx.size() < 9 || tx[0] != 0x00 || tx[1] != 0x00 || tx[2] != 0xFF) return;
+	len = tx[3];
+	if ((uint8_t)(len + tx[4]) != 0 || tx.size() < (size_t)len + 7 || len < 2) return;
+	data.assign(tx.begin() + 5, tx.begin() + 5 + len);
+	for (size_t i=0; i<data.size(); i++) sum += data[i];
+	if ((uint8_t)(sum + tx[5 + len]) != 0 || data[0] != 0xD4) return;
+
+	chip->frame.assign(ack, ack + sizeof(ack));
+	chip->frame_ack = true;
+	chip->frame_at = pn532_sim_clock_us + PN532_SIM_ACK_US;
+	chip->has_frame = true;
+
+	data = pn532_sim_command(chip, data, &chip->response_us);
+	chip->has_response = !data.empty();
+	if (chip->has_response) chip->response = pn532_sim_frame(data);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Starts the simulation with a powered, idle PN532
+*/
+/**************************************************************************/
+static void pn532_sim_start(void) {
+	pn532_sim_powercycle();
+}
+
+uint64_t pn532_sim_now(void) {
+	return pn532_sim_clock_us;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Powers a PN532 off and on: no frame pending, awake, card
+            released, MxRtyPassiveActivation back to for ever
+*/
+/**************************************************************************/
+static void pn532_sim_reset(PN532_SimChip * chip) {
+	chip->frame.clear();
+	chip->response.clear();
+	chip->last.clear();
+	chip->has_frame = false;
+	chip->frame_ack = false;
+	chip->has_response = false;
+	chip->sleep_after = false;
+	chip->asleep = false;
+	chip->in_reset = false;
+	chip->awake_at = pn532_sim_clock_us;
+	chip->listed = false;
+	chip->retries = PN532_SIM_FOREVER;
+}
+
+void pn532_sim_powercycle(void) {
+	pn532_sim_reset(&pn532_sim_chips[0]);
+	pn532_sim_reset(&pn532_sim_chips[1]);
+	pn532_sim_irq_low = false;
+}
+
+void pn532_sim_card(bool present) {
+	pn532_sim_present = present;
+}
+
+void pn532_sim_card_swap(uint8_t can) {
+	pn532_sim_can = can;
+	pn532_sim_chips[0].listed = false;
+	pn532_sim_chips[1].listed = false;
+}
+
+void pn532_sim_second_card(bool present) {
+	pn532_sim_second = present;
+}
+
+void pn532_sim_felica_card(bool present) {
+	pn532_sim_felica = present;
+}
+
+void pn532_sim_timing(uint32_t processing_us, uint32_t rf_us) {
+	pn532_sim_processing_us = processing_us;
+	pn532_sim_rf_us = rf_us;
+}
+
+void pn532_sim_card_delay(uint32_t us) {
+	pn532_sim_card_us = us;
+}
+
+void pn532_sim_wire_buffer(uint16_t size) {
+	pn532_sim_wire_size = size;
+}
+
+void pn532_sim_mux(uint8_t address, uint8_t channel) {
+	pn532_sim_mux_address = address;
+	pn532_sim_mux_channel = channel;
+}
+
+uint8_t pn532_sim_mux_control(uint8_t address) {
+	if (address < PN532_SIM_MUX_FIRST || address > PN532_SIM_MUX_LAST) return 0;
+	return pn532_sim_mux_controls[address - PN532_SIM_MUX_FIRST];
+}
+
+bool pn532_sim_listed(void) {
+	return pn532_sim_chips[0].listed;
+}
+
+uint32_t pn532_sim_reads(void) {
+	return pn532_sim_nreads;
+}
+
+uint32_t pn532_sim_writes(void) {
+	return pn532_sim_nwrites;
+}
+
+
+// Arduino core
+
+unsigned long millis(void) {
+	pn532_sim_advance(1);
+	return pn532_sim_clock_us / 1000;
+}
+
+unsigned long micros(void) {
+	pn532_sim_advance(1);
+	return pn532_sim_clock_us;
+}
+
+void delay(unsigned long ms) {
+	pn532_sim_advance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	pn532_sim_advance(us);
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+	PN532_SimChip * chip = &pn532_sim_chips[0];
+
+	if (pin != PN532_SIM_PIN_RESET) return;
+	if (value == LOW) {
+		pn532_sim_reset(chip);
+		pn532_sim_irq_low = false;
+		chip->in_reset = true;
+	} else if (chip->in_reset) {
+		chip->in_reset = false;
+		chip->awake_at = pn532_sim_clock_us + PN532_SIM_BOOT_US;
+	}
+}
+
+int digitalRead(uint8_t pin) {
+	pn532_sim_advance(1);
+	if (pin != PN532_SIM_PIN_IRQ) return HIGH;
+	return pn532_sim_irq() ? LOW : HIGH;
+}
+
+void attachInterrupt(uint8_t irq, void (*handler)(void), int) {
+	if (irq == PN532_SIM_PIN_IRQ) pn532_sim_irq_handler = handler;
+}
+
+void detachInterrupt(uint8_t irq) {
+	if (irq == PN532_SIM_PIN_IRQ) pn532_sim_irq_handler = 0;
+}
+
+
+// Wire
+
+void TwoWire::begin(void) {
+}
+
+void TwoWire::setClock(uint32_t clock) {
+	pn532_sim_bus = clock;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+	pn532_sim_txaddress = address;
+	pn532_sim_tx.clear();
+}
+
+size_t TwoWire::write(uint8_t c) {
+	pn532_sim_tx.push_back(c);
+	return 1;
+}
+
+size_t TwoWire::write(const uint8_t * buff, size_t n) {
+	pn532_sim_tx.insert(pn532_sim_tx.end(), buff, buff + n);
+	return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief  The PN532 answering at address: the second one at its own
+            address, the first one on the bus, or behind the channel it
+            was given on a multiplexer while the channel is open
+
+    @returns  The PN532, 0 if none answers
+*/
+/**************************************************************************/
+static PN532_SimChip * pn532_sim_addressed(uint8_t address) {
+	if (address == PN532_SIM_SECOND_ADDRESS) return &pn532_sim_chips[1];
+	if (address != PN532_SIM_ADDRESS) return 0;
+	if (pn532_sim_mux_address != PN532_SIM_NO_MUX &&
+		!(pn532_sim_mux_control(pn532_sim_mux_address) & (1 << pn532_sim_mux_channel))) return 0;
+	return &pn532_sim_chips[0];
+}
+
+/**************************************************************************/
+/*!
+    @brief  Holds SCL low until a booting or waking PN532 can take the
+            transfer, as the chip stretches the clock
+*/
+/**************************************************************************/
+static void pn532_sim_stretch(PN532_SimChip * chip) {
+	if (!chip->in_reset && pn532_sim_clock_us < chip->awake_at) {
+		pn532_sim_advance(chip->awake_at - pn532_sim_clock_us);
+	}
+}
+
+/**************************************************************************/
+/*!
+    @brief  Ends a write. A PN532 held in reset does not acknowledge its
+            address, a booting or waking one stretches the clock; an
+            asleep one wakes up and drops the transfer. A multiplexer
+            takes the byte written as the channels to open.
+
+    @returns  0 on success, 2 if the address was not acknowledged
+*/
+/**************************************************************************/
+uint8_t TwoWire::endTransmission(bool) {
+	PN532_SimChip * chip = pn532_sim_addressed(pn532_sim_txaddress);
+
+	pn532_sim_nwrites++;
+	if (pn532_sim_txaddress >= PN532_SIM_MUX_FIRST && pn532_sim_txaddress <= PN532_SIM_MUX_LAST) {
+		pn532_sim_advance(pn532_sim_bustime(pn532_sim_tx.size()));
+		if (pn532_sim_tx.size() == 1) pn532_sim_mux_controls[pn532_sim_txaddress - PN532_SIM_MUX_FIRST] = pn532_sim_tx[0];
+		return 0;
+	}
+	if (!chip) {
+		pn532_sim_advance(pn532_sim_bustime(pn532_sim_tx.size()));
+		return 2;
+	}
+	pn532_sim_stretch(chip);
+	pn532_sim_advance(pn532_sim_bustime(pn532_sim_tx.size()));
+
+	if (chip->in_reset) return 2;
+	if (chip->asleep) {
+		chip->asleep = false;
+		chip->awake_at = pn532_sim_clock_us + PN532_SIM_WAKE_US;
+		return 0;
+	}
+	if (!pn532_sim_tx.empty()) pn532_sim_write(chip, pn532_sim_tx);
+	return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads n bytes: the status byte, then the pending frame if it
+            is ready. The read ends the frame, whatever its length.
+
+    @returns  n, or 0 if the address was not acknowledged
+*/
+/**************************************************************************/
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t n) {
+	PN532_SimChip * chip = pn532_sim_addressed(address);
+	bool ready;
+
+	pn532_sim_nreads++;
+	if (pn532_sim_wire_size != 0 && n > pn532_sim_wire_size) n = pn532_sim_wire_size;
+	if (chip) pn532_sim_stretch(chip);
+	pn532_sim_advance(pn532_sim_bustime(n));
+	pn532_sim_rx.clear();
+	pn532_sim_rxpos = 0;
+
+	if (!chip || n == 0) return 0;
+	if (chip->in_reset || chip->asleep) return 0;
+
+	ready = chip->has_frame && pn532_sim_clock_us >= chip->frame_at;
+	pn532_sim_rx.push_back(ready ? 0x01 : 0x00);
+	for (uint8_t i=1; i<n; i++) {
+		pn532_sim_rx.push_back((ready && (size_t)i - 1 < chip->frame.size()) ? chip->frame[i - 1] : 0x00);
+	}
+	if (!ready) return n;
+
+	chip->has_frame = false;
+	if (chip->frame_ack) {
+		if (chip->has_response) {
+			chip->frame = chip->response;
+			chip->last = chip->response;
+			chip->frame_ack = false;
+			chip->frame_at = pn532_sim_clock_us + chip->response_us;
+			chip->has_frame = true;
+			chip->has_response = false;
+		}
+	} else if (chip->sleep_after && (size_t)n - 1 >= chip->frame.size()) {
+		// PowerDown once its response is read in full
+		chip->sleep_after = false;
+		chip->asleep = true;
+	}
+	pn532_sim_irq_low = pn532_sim_irq();
+	return n;
+}
+
+int TwoWire::available(void) {
+	return pn532_sim_rx.size() - pn532_sim_rxpos;
+}
+
+int TwoWire::read(void) {
+	return (pn532_sim_rxpos < pn532_sim_rx.size()) ? pn532_sim_rx[pn532_sim_rxpos++] : -1;
+}
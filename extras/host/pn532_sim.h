@@ -0,0 +1,77 @@
+/**************************************************************************/
+/*!
+    @file     pn532_sim.h
+    @author   teuteuguy
+	@license
+
+	Scripted PN532 for the host build. It sits on the fake Wire bus at
+	PN532_I2C_ADDRESS, drives the IRQ pin and honours the reset pin, and
+	answers the commands the library sends:
+
+	GetFirmwareVersion, SAMConfiguration, RFConfiguration, Diagnose,
+	PowerDown, InListPassiveTarget (106A, 106B, FeliCa),
+	InDataExchange (CEPAS read purse and read records), InRelease and
+	InAutoPoll. Anything else gets the syntax error frame.
+
+	An ACK is ready PN532_SIM_ACK_US after a command; the response
+	follows after the processing delay, or after the RF delay for the
+	commands that talk to a card. Every I2C read starts the pending
+	frame over and ends it, as on the chip: a short read loses the rest
+	of the frame until a NACK asks for it again. A PN532 held in reset
+	does not acknowledge its address; a booting or waking one stretches
+	the clock until it can take the transfer.
+
+	pn532_sim_wire_buffer() gives the Wire shim the receive buffer of a
+	core: a longer read returns only what fits, as most cores do.
+
+	For the tests of several readers, a second PN532 without IRQ or
+	reset pin answers at PN532_SIM_SECOND_ADDRESS, and pn532_sim_mux()
+	puts the first one behind a channel of an I2C multiplexer. Every
+	address from 0x70 to 0x77 acts as a TCA9548A: the byte written to it
+	is the set of channels it opens.
+*/
+/**************************************************************************/
+
+#ifndef PN532_Sim_h
+#define PN532_Sim_h
+
+#include <stdint.h>
+
+// Pins of the simulated PN532
+#define PN532_SIM_PIN_IRQ                   (2)
+#define PN532_SIM_PIN_RESET                 (3)
+#define PN532_SIM_PIN_NC                    (4) // Wired to nothing, as the pins of the second PN532
+
+// Address of the second PN532
+#define PN532_SIM_SECOND_ADDRESS            (0x25)
+
+// pn532_sim_mux(): the PN532 is on the bus itself
+#define PN532_SIM_NO_MUX                    (0xFF)
+
+// First CAN byte of the default card, the next ones count up from it
+#define PN532_SIM_CAN                       (0x10)
+
+// Default timings, us
+#define PN532_SIM_ACK_US                    (100)
+#define PN532_SIM_PROCESSING_US             (500)
+#define PN532_SIM_RF_US                     (3000)
+#define PN532_SIM_SEARCH_ROUND_US           (1500) // One empty activation attempt
+#define PN532_SIM_BOOT_US                   (25000) // From RSTPD_N high to the first answer
+#define PN532_SIM_WAKE_US                   (1000) // From the wake up transfer to the first answer
+
+uint64_t	pn532_sim_now(void);
+void		pn532_sim_powercycle(void);
+void		pn532_sim_card(bool present);
+void		pn532_sim_card_swap(uint8_t can); // Another card, CAN from can, in its place
+void		pn532_sim_second_card(bool present); // Listed with the card when 2 are asked for
+void		pn532_sim_felica_card(bool present); // Answers a FeliCa POLLING of any system code
+void		pn532_sim_timing(uint32_t processing_us, uint32_t rf_us);
+void		pn532_sim_card_delay(uint32_t us);
+void		pn532_sim_wire_buffer(uint16_t size); // 0: reads of any length
+void		pn532_sim_mux(uint8_t address, uint8_t channel); // The PN532 behind channel of the mux at address
+uint8_t		pn532_sim_mux_control(uint8_t address); // Channels open on the mux at address
+bool		pn532_sim_listed(void); // The card is listed, not released yet
+uint32_t	pn532_sim_reads(void);
+uint32_t	pn532_sim_writes(void);
+
+#endif